@@ -0,0 +1,240 @@
+/* ------------------------- chordcache --------------------------------------- */
+/*                                                                              */
+/* Loads a directory of chord shape files into memory and looks chords up.     */
+/* Written by Francois W. Nel for the Ukulele patch for Organelle.              */
+/*                                                                              */
+/* This program is free software: you can redistribute it and/or modify        */
+/* it under the terms of the GNU General Public License as published by        */
+/* the Free Software Foundation, either version 3 of the License, or           */
+/* (at your option) any later version.                                          */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,             */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of              */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               */
+/* GNU General Public License for more details.                                */
+/*                                                                              */
+/* You should have received a copy of the GNU General Public License           */
+/* along with this program.  If not, see <https://www.gnu.org/licenses/>.      */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#include "m_pd.h"
+#include <stdio.h>
+#include <string.h>
+#include "pdfiles.h"
+
+/* Version: chordcache v0.1
+ * Every "<chord name>.txt" file in the directory is read once when it is loaded, in the same
+ * format as Ukulele/Chords: the notes on the strings, one per line. A chord name symbol is
+ * answered with its notes from memory. Unknown chords are answered with the last known chord,
+ * like the patch used to do when reading a chord file failed.
+ */
+
+#define MAX_NOTES 16 /* maximum number of notes in a chord file */
+
+typedef struct
+{
+	t_symbol *name; /* chord name, NULL if the slot is empty */
+	int onset;		/* index of the first note in x_notes */
+	int count;		/* number of notes */
+} t_chordcache_entry;
+
+typedef struct chordcache
+{
+	t_object x_ob;
+
+	t_outlet *x_outnotes; /* notes of the chord */
+	t_outlet *x_outfound; /* 1 if the chord was found, 0 if the last chord was used instead */
+
+	t_symbol *x_canvasdir; /* directory of the patch, for relative paths */
+
+	t_chordcache_entry *x_table; /* open addressing hash table keyed by chord name */
+	int x_tablesize;			 /* number of slots, a power of two */
+	t_atom *x_notes;			 /* notes of all chords */
+	int x_numnotes;				 /* number of atoms allocated for x_notes */
+	int x_numchords;
+	int x_last; /* slot of the last chord found, or -1 */
+} t_chordcache;
+
+static int chordcache_find(t_chordcache *x, t_symbol *s)
+{
+	unsigned int mask = (unsigned int)x->x_tablesize - 1;
+	unsigned int i;
+
+	if (!x->x_tablesize)
+		return -1;
+	for (i = pdfiles_hash(s) & mask; x->x_table[i].name; i = (i + 1) & mask)
+		if (x->x_table[i].name == s)
+			return (int)i;
+	return -1;
+}
+
+static void chordcache_clear(t_chordcache *x)
+{
+	if (x->x_table)
+		freebytes(x->x_table, x->x_tablesize * sizeof(t_chordcache_entry));
+	if (x->x_notes)
+		freebytes(x->x_notes, x->x_numnotes * sizeof(t_atom));
+	x->x_table = 0;
+	x->x_tablesize = 0;
+	x->x_notes = 0;
+	x->x_numnotes = 0;
+	x->x_numchords = 0;
+	x->x_last = -1;
+}
+
+/* Reads the notes of one chord file onto the end of the note list. Returns the number of notes read. */
+static int chordcache_readfile(const char *path, t_atom **notes, int *numnotes, int *allocated)
+{
+	char note[MAXPDSTRING];
+	FILE *fd;
+	int count = 0;
+
+	if (!(fd = fopen(path, "r")))
+		return 0;
+	while (count < MAX_NOTES && fscanf(fd, "%999s", note) == 1)
+	{
+		if (*numnotes == *allocated)
+		{
+			*notes = (t_atom *)resizebytes(*notes, *allocated * sizeof(t_atom), 2 * *allocated * sizeof(t_atom));
+			*allocated *= 2;
+		}
+		SETSYMBOL(&(*notes)[*numnotes], gensym(note));
+		(*numnotes)++;
+		count++;
+	}
+	fclose(fd);
+	return count;
+}
+
+static void chordcache_load(t_chordcache *x, t_symbol *s)
+{
+	char dir[MAXPDSTRING], path[MAXPDSTRING], name[MAXPDSTRING];
+	t_pdfiles_dir dp;
+	const char *filename;
+	t_symbol **names;
+	int *onsets, *counts;
+	int numchords = 0, allocatedchords = 256;
+	t_atom *notes;
+	int numnotes = 0, allocatednotes = 1024;
+	int i, n, len;
+	unsigned int slot, mask;
+
+	if (sys_isabsolutepath(s->s_name))
+		snprintf(dir, sizeof(dir), "%s", s->s_name);
+	else
+		snprintf(dir, sizeof(dir), "%s/%s", x->x_canvasdir->s_name, s->s_name);
+
+	if (!pdfiles_opendir(&dp, dir, ".txt"))
+	{
+		pd_error(x, "chordcache: %s: can't open directory", dir);
+		return;
+	}
+
+	names = (t_symbol **)getbytes(allocatedchords * sizeof(t_symbol *));
+	onsets = (int *)getbytes(allocatedchords * sizeof(int));
+	counts = (int *)getbytes(allocatedchords * sizeof(int));
+	notes = (t_atom *)getbytes(allocatednotes * sizeof(t_atom));
+
+	/* read every chord file once */
+	while ((filename = pdfiles_readdir(&dp)))
+	{
+		len = (int)strlen(filename);
+		if (len <= 4 || strcmp(filename + len - 4, ".txt"))
+			continue;
+
+		if (snprintf(path, sizeof(path), "%s/%s", dir, filename) >= (int)sizeof(path))
+		{
+			pd_error(x, "chordcache: %s/%s: path too long", dir, filename);
+			continue;
+		}
+		n = numnotes;
+		if (!chordcache_readfile(path, &notes, &numnotes, &allocatednotes))
+			continue;
+
+		if (numchords == allocatedchords)
+		{
+			names = (t_symbol **)resizebytes(names, allocatedchords * sizeof(t_symbol *), 2 * allocatedchords * sizeof(t_symbol *));
+			onsets = (int *)resizebytes(onsets, allocatedchords * sizeof(int), 2 * allocatedchords * sizeof(int));
+			counts = (int *)resizebytes(counts, allocatedchords * sizeof(int), 2 * allocatedchords * sizeof(int));
+			allocatedchords *= 2;
+		}
+		snprintf(name, sizeof(name), "%.*s", len - 4, filename);
+		names[numchords] = gensym(name);
+		onsets[numchords] = n;
+		counts[numchords] = numnotes - n;
+		numchords++;
+	}
+	pdfiles_closedir(&dp);
+
+	/* replace the cache with a table that is at most half full */
+	chordcache_clear(x);
+	for (x->x_tablesize = 16; x->x_tablesize < 2 * numchords; x->x_tablesize *= 2)
+		;
+	x->x_table = (t_chordcache_entry *)getbytes(x->x_tablesize * sizeof(t_chordcache_entry));
+	x->x_notes = notes;
+	x->x_numnotes = allocatednotes;
+
+	mask = (unsigned int)x->x_tablesize - 1;
+	for (i = 0; i < numchords; i++)
+	{
+		for (slot = pdfiles_hash(names[i]) & mask; x->x_table[slot].name; slot = (slot + 1) & mask)
+			if (x->x_table[slot].name == names[i])
+				break;
+		if (!x->x_table[slot].name)
+			x->x_numchords++;
+		x->x_table[slot].name = names[i];
+		x->x_table[slot].onset = onsets[i];
+		x->x_table[slot].count = counts[i];
+	}
+	logpost(x, 3, "chordcache: loaded %d chords from %s", x->x_numchords, dir);
+
+	freebytes(names, allocatedchords * sizeof(t_symbol *));
+	freebytes(onsets, allocatedchords * sizeof(int));
+	freebytes(counts, allocatedchords * sizeof(int));
+}
+
+static void chordcache_symbol(t_chordcache *x, t_symbol *s)
+{
+	int slot = chordcache_find(x, s);
+	int found = (slot >= 0);
+
+	// fall back to the last chord that was found
+	if (!found)
+		slot = x->x_last;
+	else
+		x->x_last = slot;
+
+	outlet_float(x->x_outfound, found);
+	if (slot >= 0)
+		outlet_list(x->x_outnotes, &s_list, x->x_table[slot].count, x->x_notes + x->x_table[slot].onset);
+}
+
+static t_class *chordcache_class;
+
+static void *chordcache_new(t_symbol *s)
+{
+	t_chordcache *x = (t_chordcache *)pd_new(chordcache_class);
+
+	x->x_outnotes = outlet_new(&x->x_ob, gensym("list"));
+	x->x_outfound = outlet_new(&x->x_ob, gensym("float"));
+	x->x_canvasdir = canvas_getdir(canvas_getcurrent());
+	x->x_last = -1;
+
+	if (*s->s_name)
+		chordcache_load(x, s);
+
+	return (void *)x;
+}
+
+static void chordcache_free(t_chordcache *x)
+{
+	chordcache_clear(x);
+}
+
+void chordcache_setup(void)
+{
+	chordcache_class = class_new(gensym("chordcache"), (t_newmethod)chordcache_new, (t_method)chordcache_free, sizeof(t_chordcache), 0, A_DEFSYMBOL, 0);
+	class_addsymbol(chordcache_class, chordcache_symbol);
+	class_addmethod(chordcache_class, (t_method)chordcache_load, gensym("load"), A_SYMBOL, 0);
+}
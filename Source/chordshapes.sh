@@ -0,0 +1,62 @@
+#!/bin/sh
+# Generates the chord shape table that is compiled into notchord.
+#
+# Usage: chordshapes.sh <chord directory> > chordshapes.h
+#
+# Every "<chord name>.txt" file in the directory holds the notes on strings 1 to 4,
+# one per line. Identical shapes are stored once and shared by all chords using them.
+
+dir=${1:-Ukulele/Chords}
+
+if ! cd "$dir"; then
+	echo "chordshapes.sh: cannot open $dir" >&2
+	exit 1
+fi
+
+LC_ALL=C
+export LC_ALL
+
+for file in *.txt; do
+	printf '%s\t' "${file%.txt}"
+	tr -d '\r' <"$file" | tr '\n' ' '
+	echo
+done | awk -F '\t' -v dir="$dir" '
+BEGIN {
+	num_shapes = 0
+	num_names = 0
+}
+{
+	if (split($2, notes, " ") != 4) {
+		printf("chordshapes.sh: %s/%s.txt does not have 4 notes\n", dir, $1) > "/dev/stderr"
+		failed = 1
+		exit 1
+	}
+	shape = sprintf("{\"%s\", \"%s\", \"%s\", \"%s\"}", notes[1], notes[2], notes[3], notes[4])
+	if (!(shape in index_of)) {
+		index_of[shape] = num_shapes
+		shapes[num_shapes++] = shape
+	}
+	names[num_names] = $1
+	name_shape[num_names++] = index_of[shape]
+}
+END {
+	if (failed)
+		exit 1
+	printf("/* Generated by chordshapes.sh from %s, do not edit. */\n\n", dir)
+	printf("#define NUM_CHORD_SHAPES %d\n", num_shapes)
+	printf("#define NUM_CHORD_SHAPE_NAMES %d\n\n", num_names)
+	printf("/* Notes on strings 1 to 4 of every distinct chord shape. */\n")
+	printf("static const char *chord_shape_notes[NUM_CHORD_SHAPES][4] = {\n")
+	for (i = 0; i < num_shapes; i++)
+		printf("\t%s,\n", shapes[i])
+	printf("};\n\n")
+	printf("/* Chord names that have a shape, and the index of that shape. */\n")
+	printf("static const char *chord_shape_names[NUM_CHORD_SHAPE_NAMES] = {\n")
+	for (i = 0; i < num_names; i++)
+		printf("\t\"%s\",\n", names[i])
+	printf("};\n\n")
+	printf("static const unsigned short chord_shape_index[NUM_CHORD_SHAPE_NAMES] = {\n")
+	for (i = 0; i < num_names; i++)
+		printf("\t%d,\n", name_shape[i])
+	printf("};\n")
+}'
@@ -0,0 +1,418 @@
+/* ------------------------- chroma~ ------------------------------------------ */
+/*                                                                              */
+/* Follows the harmony of an audio signal and sends it to notchord.             */
+/* Written by Francois W. Nel for the Ukulele patch for Organelle.              */
+/*                                                                              */
+/* This program is free software: you can redistribute it and/or modify        */
+/* it under the terms of the GNU General Public License as published by        */
+/* the Free Software Foundation, either version 3 of the License, or           */
+/* (at your option) any later version.                                          */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,             */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of              */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               */
+/* GNU General Public License for more details.                                */
+/*                                                                              */
+/* You should have received a copy of the GNU General Public License           */
+/* along with this program.  If not, see <https://www.gnu.org/licenses/>.      */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#include "m_pd.h"
+#include <math.h>
+#include <string.h>
+
+/* Version: chroma~ v0.1
+ * Every hop, the last <size> samples are windowed and transformed with a real FFT. The
+ * magnitude of every bin between kMinFreq and kMaxFreq is added to the pitch class of its
+ * frequency, which gives a 12-bin chromagram. The pitch classes that reach the threshold
+ * (relative to the strongest one) are sent out as a "chord <pitch> ..." message that can
+ * go straight into notchord, so the chord is named like any other chord. The pitch class
+ * that is strongest below kBassFreq is sent an octave lower as the bass note, so that it is
+ * the lowest note that notchord gets. The notchord needs to listen to both octaves, like
+ * the [notchord 48 71] of main-next.pd.
+ *
+ * Usage: [chroma~ <size> <hop>], with the FFT size a power of two (default 4096) and the
+ * hop in samples (default 1024). Messages: "hop <samples>", "threshold <0-1>" and
+ * "gate <amplitude>" (default 0.01): chromagrams whose strongest pitch class is weaker
+ * than a sine of this amplitude count as silence.
+ *
+ * FWN: The FFT is done in steps, the permutation, every butterfly stage and the chroma
+ * fold, which are spread evenly over the blocks of the next hop instead of all running in
+ * the block that completes the hop. Every block then costs about the same, at the price
+ * of sending the chord up to a hop later. The FFT is computed here rather than with
+ * mayer_realfft, which can't be done in steps: the real signal is transformed as a
+ * complex one of half the size, and split into the real spectrum while it is folded.
+ */
+
+#define DEFAULT_SIZE 4096
+#define DEFAULT_HOP 1024
+#define MIN_SIZE 256
+#define MAX_SIZE 65536
+
+#define kMinFreq 55.f	/* A1, lowest frequency that is analysed */
+#define kMaxFreq 2000.f /* highest frequency that is analysed, above it overtones dominate */
+#define kBassFreq 200.f /* notes below this (up to G3) are candidates for the bass */
+
+#define kBassNote 48 /* octave of the bass note that is sent out */
+#define kNote 60	 /* octave of the other notes */
+
+typedef struct chroma
+{
+	t_object x_ob;
+	t_float x_f; /* for signals coming into the left inlet */
+
+	t_outlet *x_outchord;  /* "chord <pitch> ..." for notchord */
+	t_outlet *x_outchroma; /* the chromagram, 12 values between 0 and 1 */
+	t_clock *x_clock;	   /* sends the analysis out of the DSP routine */
+
+	int x_size;			/* FFT size */
+	int x_hop;			/* samples between analyses */
+	int x_count;		/* samples since the last analysis */
+	int x_writepos;		/* next sample to write in x_input */
+	t_sample *x_input;	/* ring buffer of the last x_size samples */
+	t_sample *x_window; /* Hann window */
+	t_sample *x_fft;	/* windowed samples as x_size / 2 complex numbers, then their FFT */
+	t_sample *x_twiddle; /* cos and -sin of 2 pi k / x_size, for k below x_size / 2 */
+	int *x_reverse;		 /* x_size / 2 indices, bit-reversed */
+	signed char *x_binpc; /* pitch class of every bin, -1 if it is not analysed */
+	int x_step;			 /* next step of the analysis, x_numsteps when there is none */
+	int x_numsteps;		 /* the permutation, log2(x_size / 2) stages and the fold */
+	int x_stepsperblock;
+	int x_blocksize;
+	int x_firstbin;		/* first and last analysed bins */
+	int x_lastbin;
+	int x_bassbin; /* first bin above kBassFreq */
+	t_float x_sr;
+
+	t_float x_threshold; /* share of the strongest pitch class that a pitch class needs */
+	t_float x_gate;		 /* weakest chromagram that is not silence */
+
+	t_float x_chroma[12];
+	int x_pcmask; /* pitch classes that were sent last (bit n set for pitch class n) */
+	int x_bass;	  /* bass pitch class that was sent last, or -1 */
+	int x_changed;
+	t_atom x_notes[12];
+	int x_numnotes;
+	t_atom x_chromaatoms[12];
+} t_chroma;
+
+static t_class *chroma_class;
+
+/* Maps every bin to the pitch class of its centre frequency. */
+static void chroma_map_bins(t_chroma *x)
+{
+	int i, pc;
+	float freq, binwidth = x->x_sr / x->x_size;
+
+	x->x_firstbin = (int)ceilf(kMinFreq / binwidth);
+	x->x_lastbin = (int)(kMaxFreq / binwidth);
+	if (x->x_firstbin < 1)
+		x->x_firstbin = 1;
+	if (x->x_lastbin > x->x_size / 2 - 1)
+		x->x_lastbin = x->x_size / 2 - 1;
+	x->x_bassbin = (int)ceilf(kBassFreq / binwidth);
+
+	for (i = 0; i < x->x_size / 2; i++)
+	{
+		freq = i * binwidth;
+		if (i < x->x_firstbin || i > x->x_lastbin)
+			x->x_binpc[i] = -1;
+		else
+		{
+			pc = (int)floorf(12 * log2f(freq / 440.f) + 69 + 0.5f) % 12;
+			x->x_binpc[i] = (signed char)pc;
+		}
+	}
+}
+
+/* Starts an analysis of the last x_size samples: they are windowed into x_fft, oldest
+ * first, where the even samples become the real parts and the odd ones the imaginary parts.
+ */
+static void chroma_start(t_chroma *x)
+{
+	t_sample *fft = x->x_fft, *window = x->x_window;
+	int n = x->x_size, tail = n - x->x_writepos, i;
+
+	for (i = 0; i < tail; i++)
+		fft[i] = x->x_input[x->x_writepos + i] * window[i];
+	for (i = tail; i < n; i++)
+		fft[i] = x->x_input[i - tail] * window[i];
+	x->x_step = 0;
+}
+
+/* Puts the complex numbers in bit-reversed order, for the stages. */
+static void chroma_permute(t_chroma *x)
+{
+	t_sample *z = x->x_fft, t;
+	int m = x->x_size / 2, i, j;
+
+	for (i = 0; i < m; i++)
+		if (i < (j = x->x_reverse[i]))
+		{
+			t = z[2 * i], z[2 * i] = z[2 * j], z[2 * j] = t;
+			t = z[2 * i + 1], z[2 * i + 1] = z[2 * j + 1], z[2 * j + 1] = t;
+		}
+}
+
+/* One radix-2 stage, which combines transforms of <len> / 2 points into ones of <len>. */
+static void chroma_stage(t_chroma *x, int len)
+{
+	t_sample *z = x->x_fft, *twiddle = x->x_twiddle;
+	int m = x->x_size / 2, half = len / 2, stride = 2 * (x->x_size / len), i, j, a, b;
+	t_sample wr, wi, tr, ti;
+
+	// FWN: With the twiddle factor in the outer loop, so that the early stages, with many
+	// short transforms, don't load it for every butterfly.
+	for (j = 0; j < half; j++)
+	{
+		wr = twiddle[j * stride];
+		wi = twiddle[j * stride + 1];
+		for (i = 0; i < m; i += len)
+		{
+			a = 2 * (i + j);
+			b = a + len;
+			tr = z[b] * wr - z[b + 1] * wi;
+			ti = z[b] * wi + z[b + 1] * wr;
+			z[b] = z[a] - tr;
+			z[b + 1] = z[a + 1] - ti;
+			z[a] += tr;
+			z[a + 1] += ti;
+		}
+	}
+}
+
+/* Splits the complex transform into the magnitudes of the real one, folds them into the
+ * chromagram and chooses the notes.
+ */
+static void chroma_fold(t_chroma *x)
+{
+	t_sample *z = x->x_fft, *twiddle = x->x_twiddle;
+	int m = x->x_size / 2;
+	float chroma[12] = {0}, bass[12] = {0};
+	float max = 0, bassmax = 0, scale = 4.f / x->x_size; /* a sine of amplitude 1 gives about 1 */
+	float er, ei, odr, odi, re, im, mag;
+	int i, pc, pcmask = 0, basspc = -1;
+
+	// FWN: Z(k) + conj(Z(m - k)) is twice the transform of the even samples, and
+	// Z(k) - conj(Z(m - k)) is 2i times that of the odd ones: X(k) = even + e^(-2 pi i k / size) * odd.
+	for (i = x->x_firstbin; i <= x->x_lastbin; i++)
+	{
+		er = 0.5f * (z[2 * i] + z[2 * (m - i)]);
+		ei = 0.5f * (z[2 * i + 1] - z[2 * (m - i) + 1]);
+		odr = 0.5f * (z[2 * i + 1] + z[2 * (m - i) + 1]);
+		odi = -0.5f * (z[2 * i] - z[2 * (m - i)]);
+		re = er + twiddle[2 * i] * odr - twiddle[2 * i + 1] * odi;
+		im = ei + twiddle[2 * i] * odi + twiddle[2 * i + 1] * odr;
+		mag = scale * sqrtf(re * re + im * im);
+		chroma[(int)x->x_binpc[i]] += mag;
+		if (i < x->x_bassbin)
+			bass[(int)x->x_binpc[i]] += mag;
+	}
+
+	for (pc = 0; pc < 12; pc++)
+	{
+		if (chroma[pc] > max)
+			max = chroma[pc];
+		if (bass[pc] > bassmax)
+			bassmax = bass[pc], basspc = pc;
+	}
+
+	for (pc = 0; pc < 12; pc++)
+	{
+		x->x_chroma[pc] = max > 0 ? chroma[pc] / max : 0;
+		if (max >= x->x_gate && x->x_chroma[pc] >= x->x_threshold)
+			pcmask |= 1 << pc;
+	}
+	if (basspc >= 0 && !(pcmask & (1 << basspc))) /* the bass must be one of the notes */
+		basspc = -1;
+
+	if (pcmask != x->x_pcmask || basspc != x->x_bass)
+	{
+		x->x_pcmask = pcmask;
+		x->x_bass = basspc;
+		x->x_numnotes = 0;
+		if (basspc >= 0)
+			SETFLOAT(&x->x_notes[x->x_numnotes], kBassNote + basspc), x->x_numnotes++;
+		for (pc = 0; pc < 12; pc++)
+			if ((pcmask & (1 << pc)) && pc != basspc)
+				SETFLOAT(&x->x_notes[x->x_numnotes], kNote + pc), x->x_numnotes++;
+		x->x_changed = 1;
+	}
+	clock_delay(x->x_clock, 0);
+}
+
+static void chroma_step(t_chroma *x)
+{
+	if (x->x_step == 0)
+		chroma_permute(x);
+	else if (x->x_step < x->x_numsteps - 1)
+		chroma_stage(x, 2 << (x->x_step - 1));
+	else
+		chroma_fold(x);
+	x->x_step++;
+}
+
+/* Spreads the steps of an analysis over the blocks of a hop, as far as there are blocks. */
+static void chroma_spread(t_chroma *x)
+{
+	int blocks = x->x_hop / x->x_blocksize;
+
+	if (blocks < 1)
+		blocks = 1;
+	x->x_stepsperblock = (x->x_numsteps + blocks - 1) / blocks;
+}
+
+static void chroma_tick(t_chroma *x)
+{
+	int pc;
+
+	for (pc = 0; pc < 12; pc++)
+		SETFLOAT(&x->x_chromaatoms[pc], x->x_chroma[pc]);
+	outlet_list(x->x_outchroma, &s_list, 12, x->x_chromaatoms);
+	if (x->x_changed)
+	{
+		x->x_changed = 0;
+		outlet_anything(x->x_outchord, gensym("chord"), x->x_numnotes, x->x_notes);
+	}
+}
+
+static t_int *chroma_perform(t_int *w)
+{
+	t_chroma *x = (t_chroma *)(w[1]);
+	t_sample *in = (t_sample *)(w[2]);
+	int n = (int)(w[3]);
+	int i, chunk;
+
+	// FWN: The steps come before the samples, so that the block in which a hop ends, and
+	// the next analysis is started, doesn't also do a step of it.
+	for (i = 0; i < x->x_stepsperblock && x->x_step < x->x_numsteps; i++)
+		chroma_step(x);
+	while (n > 0)
+	{
+		chunk = x->x_size - x->x_writepos;
+		if (chunk > n)
+			chunk = n;
+		if (chunk > x->x_hop - x->x_count)
+			chunk = x->x_hop - x->x_count;
+		for (i = 0; i < chunk; i++)
+			x->x_input[x->x_writepos + i] = in[i];
+		in += chunk;
+		n -= chunk;
+		x->x_writepos = (x->x_writepos + chunk) & (x->x_size - 1);
+		x->x_count += chunk;
+		if (x->x_count == x->x_hop)
+		{
+			x->x_count = 0;
+			while (x->x_step < x->x_numsteps) /* only if the hop is shorter than the steps */
+				chroma_step(x);
+			chroma_start(x);
+		}
+	}
+	return (w + 4);
+}
+
+static void chroma_dsp(t_chroma *x, t_signal **sp)
+{
+	if (sp[0]->s_sr != x->x_sr)
+	{
+		x->x_sr = sp[0]->s_sr;
+		chroma_map_bins(x);
+	}
+	x->x_blocksize = sp[0]->s_n;
+	chroma_spread(x);
+	dsp_add(chroma_perform, 3, x, sp[0]->s_vec, (t_int)sp[0]->s_n);
+}
+
+static void chroma_hop(t_chroma *x, t_floatarg f)
+{
+	int hop = (int)f;
+	x->x_hop = hop < 1 ? 1 : hop > x->x_size ? x->x_size : hop;
+	x->x_count = 0;
+	chroma_spread(x);
+}
+
+static void chroma_threshold(t_chroma *x, t_floatarg f)
+{
+	x->x_threshold = f < 0 ? 0 : f > 1 ? 1 : f;
+}
+
+static void chroma_gate(t_chroma *x, t_floatarg f)
+{
+	x->x_gate = f < 0 ? 0 : f;
+}
+
+static void *chroma_new(t_floatarg size, t_floatarg hop)
+{
+	t_chroma *x = (t_chroma *)pd_new(chroma_class);
+	int n;
+
+	/* the FFT size must be a power of two */
+	for (n = MIN_SIZE; n < size && n < MAX_SIZE; n *= 2)
+		;
+	if (size <= 0)
+		n = DEFAULT_SIZE;
+	else if (n != (int)size)
+		post("chroma~: FFT size %d is not a power of two, using %d", (int)size, n);
+
+	x->x_size = n;
+	x->x_input = (t_sample *)getbytes(n * sizeof(t_sample));
+	x->x_window = (t_sample *)getbytes(n * sizeof(t_sample));
+	x->x_fft = (t_sample *)getbytes(n * sizeof(t_sample));
+	x->x_twiddle = (t_sample *)getbytes(n * sizeof(t_sample));
+	x->x_binpc = (signed char *)getbytes(n / 2);
+	for (int i = 0; i < n; i++)
+		x->x_window[i] = 0.5f - 0.5f * cosf(2 * 3.14159265f * i / n);
+	for (int i = 0; i < n / 2; i++)
+	{
+		x->x_twiddle[2 * i] = (t_sample)cos(2 * 3.14159265358979 * i / n);
+		x->x_twiddle[2 * i + 1] = (t_sample)-sin(2 * 3.14159265358979 * i / n);
+	}
+	x->x_reverse = (int *)getbytes((n / 2) * sizeof(int));
+	for (int i = 1, j = 0, bit; i < n / 2; i++)
+	{
+		for (bit = n / 4; j & bit; bit >>= 1)
+			j ^= bit;
+		x->x_reverse[i] = (j |= bit);
+	}
+	for (x->x_numsteps = 2; 1 << (x->x_numsteps - 1) <= n / 2; x->x_numsteps++)
+		;
+	x->x_step = x->x_numsteps;
+	x->x_blocksize = 64;
+
+	chroma_hop(x, hop > 0 ? hop : DEFAULT_HOP);
+	x->x_threshold = 0.5f;
+	x->x_gate = 0.01f;
+	if ((x->x_sr = sys_getsr()) > 0)
+		chroma_map_bins(x);
+	x->x_bass = -1;
+
+	x->x_outchord = outlet_new(&x->x_ob, &s_anything);
+	x->x_outchroma = outlet_new(&x->x_ob, &s_list);
+	x->x_clock = clock_new(x, (t_method)chroma_tick);
+
+	return (void *)x;
+}
+
+static void chroma_free(t_chroma *x)
+{
+	int n = x->x_size;
+
+	clock_free(x->x_clock);
+	freebytes(x->x_input, n * sizeof(t_sample));
+	freebytes(x->x_window, n * sizeof(t_sample));
+	freebytes(x->x_fft, n * sizeof(t_sample));
+	freebytes(x->x_twiddle, n * sizeof(t_sample));
+	freebytes(x->x_reverse, (n / 2) * sizeof(int));
+	freebytes(x->x_binpc, n / 2);
+}
+
+void chroma_tilde_setup(void)
+{
+	chroma_class = class_new(gensym("chroma~"), (t_newmethod)chroma_new, (t_method)chroma_free, sizeof(t_chroma), 0, A_DEFFLOAT, A_DEFFLOAT, 0);
+	CLASS_MAINSIGNALIN(chroma_class, t_chroma, x_f);
+	class_addmethod(chroma_class, (t_method)chroma_dsp, gensym("dsp"), A_CANT, 0);
+	class_addmethod(chroma_class, (t_method)chroma_hop, gensym("hop"), A_FLOAT, 0);
+	class_addmethod(chroma_class, (t_method)chroma_threshold, gensym("threshold"), A_FLOAT, 0);
+	class_addmethod(chroma_class, (t_method)chroma_gate, gensym("gate"), A_FLOAT, 0);
+}
@@ -25,11 +25,17 @@
 #include "m_pd.h"
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 #ifndef _WIN32
 #include <stdlib.h>
+#include <time.h>
+#else
+#include <windows.h>
 #endif
 
-#define MAX_POLY 32 /* maximum number of notes played at a time */
+#include "chordshapes.h" /* FWN: Generated from Ukulele/Chords by the Makefile. */
+
+#define NUM_NOTES 128 /* number of MIDI note numbers */
 
 #define kUnison 0
 #define kMaj 1
@@ -103,6 +109,17 @@
 #define kDefault 69
 
 #define kXX -1
+#define kNoRoot 12 /* index of "no root " in pitch_class[] */
+
+#define NUM_PC_SETS 4096 /* number of 12-bit pitch class sets */
+
+#define kTableMode 0	/* FWN: Look the chord up in chord_table[]. */
+#define kTemplateMode 1 /* FWN: Score the notes against the template of every chord. */
+
+#define NUM_TEMPLATES kChrom /* FWN: Chord types that have a template (all but kChrom and kNone). */
+#define NUM_ROOTS 16		 /* FWN: 12 roots, padded so that the scoring loops vectorize. */
+#define MAX_CANDIDATES 12	 /* FWN: Maximum number of chords reported in template mode. */
+#define kBassWeight 0.1f	 /* FWN: Share of the score given for the root being in the bass. */
 
 /* Version: notchord v0.1
  * Based on chord v0.2 written by Olaf Matthes <olaf.matthes@gmx.de>.
@@ -111,12 +128,133 @@
 
 static char *pitch_class[13] = {"C ", "Db ", "D ", "Eb ", "E ", "F ", "Gb ", "G ", "Ab ", "A ", "Bb ", "B ", "no root "};
 
+/* FWN: Name of each chord type, indexed by type. */
+static char *chord_type_name[kDefault] = {
+	"unison",               /* kUnison */
+	"major",                /* kMaj */
+	"minor",                /* kMin */
+	"diminished",           /* kDim */
+	"augmented",            /* kAug */
+	"major 7th",            /* kMaj7 */
+	"dominant 7th",         /* kDom7 */
+	"minor 7th",            /* kMin7 */
+	"half diminished 7th",  /* kHalfDim7 */
+	"diminished 7th",       /* kDim7 */
+	"minor major 7th",      /* kMinMaj7 */
+	"major 7th #5",         /* kMaj7s5 */
+	"major 7th b5",         /* kMaj7b5 */
+	"dominant 7th #5",      /* kDom7s5 */
+	"dominant 7th b5",      /* kDom7b5 */
+	"dominant b9",          /* kDomb9 */
+	"major 9th",            /* kMaj9 */
+	"dominant 9th",         /* kDom9 */
+	"minor 9th",            /* kMin9 */
+	"half diminished 9th",  /* kHalfDim9 */
+	"minor major 9th",      /* kMinMaj9 */
+	"diminished major 9th", /* kDimMaj9 */
+	"major 9th b5",         /* kMaj9b5 */
+	"dominant 9th b5",      /* kDom9b5 */
+	"dominant 9th b13",     /* kDom9b13 */
+	"minor 9th #11",        /* kMin9s11 */
+	"minor/maj 9th b11",    /* kmM9b11 */
+	"major 7th b9",         /* kMaj7b9 */
+	"major 7th #5 b9",      /* kMaj7s5b9 */
+	"dominant 7th b9",      /* kDom7b9 */
+	"minor 7th b9",         /* kMin7b9 */
+	"minor b9 #11",         /* kMinb9s11 */
+	"half diminished b9",   /* kHalfDimb9 */
+	"diminished b9",        /* kDim7b9 */
+	"minor major b9",       /* kMinMajb9 */
+	"diminished M7 b9",     /* kDimMajb9 */
+	"major 7th #9",         /* kMaj7s9 */
+	"dominant #9",          /* kDom7s9 */
+	"major 7th #11",        /* kMaj7s11 */
+	"major #9 #11",         /* kMs9s11 */
+	"half diminished b11",  /* kHDimb11 */
+	"major 11th",           /* kMaj11 */
+	"dominant 11th",        /* kDom11 */
+	"minor 11th",           /* kMin11 */
+	"half diminished 11th", /* kHalfDim11 */
+	"diminished 11th",      /* kDim11 */
+	"minor major 11th",     /* kMinMaj11 */
+	"diminished maj 11th",  /* kDimMaj11 */
+	"major 11th b5",        /* kMaj11b5 */
+	"major 11th #5",        /* kMaj11s5 */
+	"major 11th b9",        /* kMaj11b9 */
+	"major 11th #9",        /* kMaj11s9 */
+	"major 11th b13",       /* kMaj11b13 */
+	"major 11th #13",       /* kMaj11s13 */
+	"major 11th b5 b9",     /* kM11b5b9 */
+	"dominant 11th b5",     /* kDom11b5 */
+	"dominant 11th b9",     /* kDom11b9 */
+	"dominant 11th #9",     /* kDom11s9 */
+	"half dim 11th b9",     /* kHalfDim11b9 */
+	"dominant #11",         /* kDom7s11 */
+	"minor 7th #11",        /* kMin7s11 */
+	"dominant 13th #11",    /* kDom13s11 */
+	"major 7 b9 13",        /* kM7b913 */
+	"major 7th #13",        /* kMaj7s13 */
+	"major 9th #13",        /* kMaj9s13 */
+	"major 7 b9 #13",       /* kM7b9s13 */
+	"dominant 7th b13",     /* kDom7b13 */
+	"chromatic",            /* kChrom */
+	"unknown",              /* kNone */
+};
+
+/* FWN: Chord name symbols for every root (including "no root ") and type, interned once in notchord_setup(). */
+static t_symbol *chord_name[13][kDefault];
+
+/* FWN: Ukulele chord shape for every root and type (-1 if there is none), and the notes
+ * of every shape ready for output.
+ */
+static short chord_shape[13][kDefault];
+static t_atom chord_shape_atoms[NUM_CHORD_SHAPES][4];
+
 typedef struct
 {
 	int type;
 	int rootMember;
 } t_type_root;
 
+/* FWN: Packed result of the chord finder for one pitch class set:
+ * bits 0-6 hold the chord type, bits 7-10 the root, bits 11-12 the inversion
+ * and bits 13-14 the number of dissonant members that were kicked out to find it.
+ */
+typedef unsigned short t_chord_entry;
+
+#define ENTRY_TYPE(e) ((e)&0x7f)
+#define ENTRY_ROOT(e) (((e) >> 7) & 0x0f)
+#define ENTRY_INVERSION(e) (((e) >> 11) & 0x03)
+#define ENTRY_DEPTH(e) (((e) >> 13) & 0x03)
+
+/* FWN: Dense chord table indexed by the pitch class mask (bit n set for pitch class n).
+ * Built once in notchord_setup() so that the note path costs a single lookup.
+ */
+static t_chord_entry chord_table[NUM_PC_SETS];
+
+/* FWN: Pitch classes of every chord type with its root on C, as weights for template
+ * scoring (1 for every member) and as a mask, and 1 / sqrt(number of members).
+ */
+static float chord_template[NUM_TEMPLATES][12];
+static int chord_template_mask[NUM_TEMPLATES];
+static float chord_template_norm[NUM_TEMPLATES];
+
+/* FWN: Counters reported by the "stats" message. */
+typedef struct
+{
+	unsigned long events;	  /* note messages processed */
+	unsigned long detections; /* chords detected */
+	unsigned long hits;		  /* table entries found without kicking out members */
+	unsigned long fallbacks;  /* table entries found by kicking out members */
+	int maxdepth;			  /* most members kicked out for one chord */
+	unsigned long droppedon;  /* note-ons for notes that were already playing */
+	unsigned long droppedoff; /* note-offs for notes that were not playing */
+	unsigned long ignored;	  /* notes outside of the note range */
+	double mintime;			  /* detection time in microseconds */
+	double maxtime;
+	double totaltime;
+} t_chord_stats;
+
 typedef struct chord
 {
 	t_object x_ob;
@@ -124,77 +262,81 @@ typedef struct chord
 	t_inlet *x_invelo;		   /* inlet for velocity */
 	t_inlet *x_indefaultchord; /* inlet for default chord */
 	t_outlet *x_outchordname;  /* chord name, e.g. "Cmajor7" */
-
-	t_int x_pitch;
-	t_int x_pc[12];		/* pitch class array */
-	t_int x_abs_pc[12]; /* pitch class array: absolute MIDI note numbers */
-	t_int x_velo;
-	t_int x_alloctable[MAX_POLY]; /* a table used to store all playing notes */
-	t_int x_poly;				  /* number of notes currently playing */
-	t_atom x_chordlist[12];		  /* list that stores the note numbers for output */
-	t_int x_lowerlimit;			  /* FWN: Lowest note number to process (inclusive). */
-	t_int x_upperlimit;			  /* FWN: Highest note number to process (inclusive). */
-	t_symbol *x_defaultchord;	 /* FWN: The default chord to output if no notes are pressed. */
-
-	t_int x_chord_type;		 /* chord's type (number between 0 and 68) */
-	t_int x_chord_root;		 /* chord's root (pitch class) */
-	t_int x_chord_bass;		 /* chord's bass note (MIDI note number) */
-	t_int x_chord_inversion; /* chord's state of inversion (root, 1st, 2nd) */
+	t_outlet *x_outshape;	   /* FWN: notes on strings 1 to 4 for the chord, e.g. "C5 E4 C4 G4" */
+	t_outlet *x_outcandidates; /* FWN: best chords and their scores in template mode */
+	t_outlet *x_outinfo;	   /* FWN: replies to "stats" */
+
+	unsigned int x_notes[NUM_NOTES / 32]; /* FWN: Bitmap of the notes currently playing. */
+	unsigned char x_pc[12];				  /* FWN: Number of playing notes per pitch class. */
+	int x_abs_pc[12];					  /* pitch class array: lowest absolute MIDI note numbers */
+	unsigned char x_velocity[NUM_NOTES];  /* FWN: Velocity of every playing note. */
+	int x_pcmask;						  /* FWN: Pitch classes present (bit n set for pitch class n). */
+	int x_numpc;						  /* FWN: Number of pitch classes present. */
+	int x_velo;
+	int x_poly;				  /* number of notes currently playing */
+	t_atom x_chordlist[12];	  /* list that stores the note numbers for output */
+	int x_lowerlimit;		  /* FWN: Lowest note number to process (inclusive). */
+	int x_upperlimit;		  /* FWN: Highest note number to process (inclusive). */
+	t_symbol *x_defaultchord; /* FWN: The default chord to output if no notes are pressed. */
+	t_symbol *x_lastchord;	  /* FWN: The chord that was output last. */
+	t_symbol *x_defaultshapechord; /* FWN: The default chord that x_defaultshape was looked up for. */
+	int x_defaultshape;			   /* FWN: Chord shape of the default chord. */
+	int x_changesonly;		  /* FWN: Only output a chord if it differs from the last one. */
+	t_float x_hold;			  /* FWN: Time in ms to wait for further note-offs before outputting a released chord. */
+	t_clock *x_holdclock;	  /* FWN: Outputs the chord once the hold time has passed. */
+	t_float x_coalesce;		  /* FWN: Time in ms to collect notes before detecting the chord (negative: detect on every note). */
+	t_clock *x_detectclock;	  /* FWN: Detects the chord once the coalescing time has passed. */
+	int x_pending;			  /* FWN: Set while a detection is scheduled. */
+	int x_noteon;			  /* FWN: Set if a note-on arrived since the last detection. */
+	int x_mode;				  /* FWN: kTableMode or kTemplateMode. */
+	int x_topk;				  /* FWN: Number of chords to report in template mode. */
+	int x_numcandidates;	  /* FWN: Number of chords in x_candidates. */
+	t_atom x_candidates[2 * MAX_CANDIDATES]; /* FWN: Best chords found by template scoring, each followed by its score. */
+	int x_mappedshape;		  /* FWN: Shape of the best scoring chord that has one, or -1. */
+	t_chord_stats x_stats;	  /* FWN: Counters since creation or the last "reset". */
+
+	int x_chord_type;	   /* chord's type (number between 0 and 68) */
+	int x_chord_root;	   /* chord's root (pitch class) */
+	int x_chord_bass;	   /* chord's bass note (MIDI note number) */
+	int x_chord_inversion; /* chord's state of inversion (root, 1st, 2nd) */
 
 } t_chord;
 
 /* functions */
-static void chord_kick_out_member(t_chord *x, t_int number, t_int *members);
-static void chord_chord_finder(t_chord *x, t_int num_pcs);
+static t_chord_entry chord_kick_out_member(int number, int *members);
+static t_chord_entry chord_chord_finder(int mask);
 static void chord_draw_chord_type(t_chord *x);
 
-static void chord_default(t_chord *x)
+static t_chord_entry chord_pack(int type, int root, int inversion)
 {
-	x->x_chord_type = kDefault;
-	chord_draw_chord_type(x); // output onto the screen
+	return (t_chord_entry)(type | (root << 7) | (inversion << 11));
 }
 
-static void chord_unison(t_chord *x)
+static t_chord_entry chord_unison(int *members)
 {
-	int i;
-	int member = 0;
-	for (i = 0; i < 12; i++)
-		if (x->x_pc[i])
-		{
-			member = i; // find pitch class
-			break;
-		}
-	x->x_chord_type = 0;
-	x->x_chord_root = member;
-	chord_draw_chord_type(x); // output onto the screen
+	return chord_pack(kUnison, members[0], 0);
 }
 
-static void chord_dyad(t_chord *x)
+static t_chord_entry chord_dyad(int *members)
 {
 	static t_type_root dyads[11] =
 		{{kMaj7, 1}, {kDom7, 1}, {kMin, 0}, {kMaj, 0}, {kMaj, 1}, {kDom7, 0}, {kMaj, 0}, {kMaj, 1}, {kMin, 1}, {kDom7, 0}, {kMaj7, 0}};
 	register t_type_root *t;
 
-	int members[2];
-	int i, j = 0;
 	int interval1;
+	int root;
 
-	for (i = 0; i < 12; i++)
-		if (x->x_pc[i])
-			members[j++] = i;			 /* load members array with chord pitch classes */
 	interval1 = members[1] - members[0]; /* calculate interval between first two members */
 	interval1 = interval1 - 1;			 /* reduce interval1 to start at zero */
 	t = &(dyads[interval1]);			 /* find TypeRoot struct for this interval */
-	x->x_chord_type = t->type;
 	if (interval1 == 5)
-		x->x_chord_root = (members[0] + 8) % 12;
+		root = (members[0] + 8) % 12;
 	else
-		x->x_chord_root = members[t->rootMember];
-	x->x_chord_inversion = t->rootMember; /* get state of inversion */
-	chord_draw_chord_type(x);			  /* output results */
+		root = members[t->rootMember];
+	return chord_pack(t->type, root, t->rootMember); /* rootMember is the state of inversion */
 }
 
-static void chord_triad(t_chord *x)
+static t_chord_entry chord_triad(int *members)
 {
 	static t_type_root triads[10][10] =
 		{/* interval1 is a half step			*/
@@ -219,35 +361,29 @@ static void chord_triad(t_chord *x)
 		 {{kMaj7b9, 2}}};
 	register t_type_root *t;
 
-	int members[3];
-	int i, j = 0;
 	int interval1, interval2;
+	int inversion = 0;
 
-	for (i = 0; i < 12; i++)
-		if (x->x_pc[i])
-			members[j++] = i;			   /* load members array with chord pitch classes */
 	interval1 = members[1] - members[0];   /* calculate interval between first two members */
 	interval2 = members[2] - members[0];   /* calculate interval between first and third */
 	interval2 = interval2 - interval1 - 1; /* reduce interval2 to start at zero */
 	interval1 = interval1 - 1;			   /* reduce interval1 to start at zero */
 	t = &(triads[interval1][interval2]);   /* find TypeRoot struct for this interval vector */
-	x->x_chord_type = t->type;
-	x->x_chord_root = members[t->rootMember];
 	switch (t->rootMember)
 	{ /* get state of inversion */
 	case 0:
-		x->x_chord_inversion = 0;
+		inversion = 0;
 		break;
 	case 1:
-		x->x_chord_inversion = 2;
+		inversion = 2;
 		break;
 	case 2:
-		x->x_chord_inversion = 1;
+		inversion = 1;
 	}
-	chord_draw_chord_type(x); /* output onto the screen */
+	return chord_pack(t->type, members[t->rootMember], inversion);
 }
 
-static void chord_quartad(t_chord *x)
+static t_chord_entry chord_quartad(int *members)
 {
 	static t_type_root quartads[9][9][9] =
 		{
@@ -473,12 +609,9 @@ static void chord_quartad(t_chord *x)
 
 	register t_type_root *t;
 
-	int members[4];
 	int interval1, interval2, interval3;
-	int i, j = 0;
-	for (i = 0; i < 12; i++)
-		if (x->x_pc[i])
-			members[j++] = i;			   /* load members array with chord pitch classes */
+	int inversion = 0;
+
 	interval1 = members[1] - members[0];   /* calculate interval between first two members */
 	interval2 = members[2] - members[0];   /* calculate interval between first and third */
 	interval3 = members[3] - members[0];   /* calculate interval between first and third */
@@ -488,23 +621,21 @@ static void chord_quartad(t_chord *x)
 
 	/* find TypeRoot struct for this interval set */
 	t = &(quartads[interval1][interval2][interval3]);
-	x->x_chord_type = t->type;
-	x->x_chord_root = members[t->rootMember];
 	switch (t->rootMember)
 	{ /* get state of inversion */
 	case 0:
-		x->x_chord_inversion = 0;
+		inversion = 0;
 		break;
 	case 1:
-		x->x_chord_inversion = 2;
+		inversion = 2;
 		break;
 	case 2:
-		x->x_chord_inversion = 2;
+		inversion = 2;
 		break;
 	case 3:
-		x->x_chord_inversion = 1;
+		inversion = 1;
 	}
-	chord_draw_chord_type(x); /* output results */
+	return chord_pack(t->type, members[t->rootMember], inversion);
 }
 
 static void chord_fatal_error(char *s1, char *s2)
@@ -512,14 +643,14 @@ static void chord_fatal_error(char *s1, char *s2)
 	post("chord: error: %s : %s", s1, s2);
 }
 
-static void chord_quintad(t_chord *x)
+static t_chord_entry chord_quintad(int *members)
 {
 	static int initialized = 0;
 	static t_type_root quintads[8][8][8][8];
 	register int i, j, k, l;
 	register t_type_root *t;
-	t_int members[5];
 	int interval1, interval2, interval3, interval4;
+	int inversion = 0;
 	int *st;
 	int maj9[5][4] = {{1, 1, 2, 3}, {0, 1, 1, 2}, {3, 0, 1, 1}, {2, 3, 0, 1}, {1, 2, 3, 0}};
 	int dom9[5][4] = {{1, 1, 2, 2}, {1, 1, 1, 2}, {2, 1, 1, 1}, {2, 2, 1, 1}, {1, 2, 2, 1}};
@@ -1120,13 +1251,8 @@ static void chord_quintad(t_chord *x)
 		}
 
 		initialized = 1;
-		return;
 	}
 
-	j = 0;
-	for (i = 0; i < 12; i++)
-		if (x->x_pc[i])
-			members[j++] = i;			   /* load members array with chord pitch classes */
 	interval1 = members[1] - members[0];   /* calculate interval between first two members */
 	interval2 = members[2] - members[0];   /* calculate interval between first and third */
 	interval3 = members[3] - members[0];   /* calculate interval between first and third */
@@ -1140,40 +1266,38 @@ static void chord_quintad(t_chord *x)
 	t = &(quintads[interval1][interval2][interval3][interval4]);
 	if (t->rootMember != kXX)
 	{
-		x->x_chord_type = t->type;
-		x->x_chord_root = members[t->rootMember];
 		switch (t->rootMember)
 		{ /* get state of inversion */
 		case 0:
-			x->x_chord_inversion = 0;
+			inversion = 0;
 			break;
 		case 1:
-			x->x_chord_inversion = 2;
+			inversion = 2;
 			break;
 		case 2:
-			x->x_chord_inversion = 2;
+			inversion = 2;
 			break;
 		case 3:
-			x->x_chord_inversion = 2;
+			inversion = 2;
 			break;
 		case 4:
-			x->x_chord_inversion = 1;
+			inversion = 1;
 		}
-		chord_draw_chord_type(x); /* output result */
+		return chord_pack(t->type, members[t->rootMember], inversion);
 	}
 	else
-		chord_kick_out_member(x, 5, members);
+		return chord_kick_out_member(5, members);
 }
 
-static void chord_sextad(t_chord *x)
+static t_chord_entry chord_sextad(int *members)
 {
 	static int initialized = 0;
 	static t_type_root sextads[7][7][7][7][7];
 	register int i, j, k, l, m;
 	register t_type_root *t;
 	register int *st;
-	t_int members[6];
 	int interval1, interval2, interval3, interval4, interval5;
+	int inversion = 0;
 
 	int D9b3[6][5] =
 		{{1, 1, 2, 0, 1}, {1, 1, 1, 2, 0}, {1, 1, 1, 1, 2}, {0, 1, 1, 1, 1}, {2, 0, 1, 1, 1}, {1, 2, 0, 1, 1}};
@@ -1384,13 +1508,8 @@ static void chord_sextad(t_chord *x)
 		}
 
 		initialized = 1;
-		return;
 	}
 
-	j = 0;
-	for (i = 0; i < 12; i++)
-		if (x->x_pc[i])
-			members[j++] = i;			   // load members array with chord pitch classes
 	interval1 = members[1] - members[0];   // calculate interval between first two members
 	interval2 = members[2] - members[0];   // calculate interval between first and third
 	interval3 = members[3] - members[0];   // calculate interval between first and third
@@ -1406,272 +1525,98 @@ static void chord_sextad(t_chord *x)
 	t = &(sextads[interval1][interval2][interval3][interval4][interval5]);
 	if (t->rootMember != kXX)
 	{
-		x->x_chord_type = t->type;
-		x->x_chord_root = members[t->rootMember];
 		switch (t->rootMember)
 		{ /* get state of inversion */
 		case 0:
-			x->x_chord_inversion = 0;
+			inversion = 0;
 			break;
 		case 1:
-			x->x_chord_inversion = 2;
+			inversion = 2;
 			break;
 		case 2:
-			x->x_chord_inversion = 2;
+			inversion = 2;
 			break;
 		case 3:
-			x->x_chord_inversion = 2;
+			inversion = 2;
 			break;
 		case 4:
-			x->x_chord_inversion = 2;
+			inversion = 2;
 			break;
 		case 5:
-			x->x_chord_inversion = 1;
+			inversion = 1;
 		}
-		chord_draw_chord_type(x); // output onto the screen
+		return chord_pack(t->type, members[t->rootMember], inversion);
 	}
 	else
-		chord_kick_out_member(x, 6, members);
+		return chord_kick_out_member(6, members);
+}
+
+/* FWN: Finds the chord shape of the default chord, which can be any symbol. */
+static int chord_default_shape(t_chord *x)
+{
+	int root, type;
+
+	if (x->x_defaultchord != x->x_defaultshapechord)
+	{
+		x->x_defaultshapechord = x->x_defaultchord;
+		x->x_defaultshape = -1;
+		for (root = 0; root < 13; root++)
+			for (type = 0; type < kDefault; type++)
+				if (chord_name[root][type] == x->x_defaultchord)
+					x->x_defaultshape = chord_shape[root][type];
+	}
+	return x->x_defaultshape;
 }
 
 static void chord_draw_chord_type(t_chord *x)
 {
-	char chord[255]; /* output string */
+	t_symbol *chord;
+	int shape;
+
+	/* chords of more than six pitch classes are not reported */
+	if (x->x_chord_type == kChrom)
+		return;
 
 	if (x->x_chord_type == kDefault)
 	{
-		outlet_symbol(x->x_outchordname, x->x_defaultchord);
+		chord = x->x_defaultchord;
+		shape = chord_default_shape(x);
 	}
 	else
 	{
-		chord[0] = '\0';
-		strcat(chord, pitch_class[x->x_chord_root]);
-
-		/* append name of chord type */
-		switch (x->x_chord_type)
-		{
-		case kUnison:
-			strcat(chord, "unison");
-			break;
-		case kMaj:
-			strcat(chord, "major");
-			break;
-		case kMin:
-			strcat(chord, "minor");
-			break;
-		case kDim:
-			strcat(chord, "diminished");
-			break;
-		case kAug:
-			strcat(chord, "augmented");
-			break;
-		case kMaj7:
-			strcat(chord, "major 7th");
-			break;
-		case kDom7:
-			strcat(chord, "dominant 7th");
-			break;
-		case kMin7:
-			strcat(chord, "minor 7th");
-			break;
-		case kHalfDim7:
-			strcat(chord, "half diminished 7th");
-			break;
-		case kDim7:
-			strcat(chord, "diminished 7th");
-			break;
-		case kMinMaj7:
-			strcat(chord, "minor major 7th");
-			break;
-		case kMaj7s5:
-			strcat(chord, "major 7th #5");
-			break;
-		case kMaj7b5:
-			strcat(chord, "major 7th b5");
-			break;
-		case kDom7s5:
-			strcat(chord, "dominant 7th #5");
-			break;
-		case kDom7b5:
-			strcat(chord, "dominant 7th b5");
-			break;
-		case kDomb9:
-			strcat(chord, "dominant b9");
-			break;
-		case kMaj9:
-			strcat(chord, "major 9th");
-			break;
-		case kDom9:
-			strcat(chord, "dominant 9th");
-			break;
-		case kMin9:
-			strcat(chord, "minor 9th");
-			break;
-		case kHalfDim9:
-			strcat(chord, "half diminished 9th");
-			break;
-		case kMinMaj9:
-			strcat(chord, "minor major 9th");
-			break;
-		case kDimMaj9:
-			strcat(chord, "diminished major 9th");
-			break;
-		case kMaj9b5:
-			strcat(chord, "major 9th b5");
-			break;
-		case kDom9b5:
-			strcat(chord, "dominant 9th b5");
-			break;
-		case kDom9b13:
-			strcat(chord, "dominant 9th b13");
-			break;
-		case kMin9s11:
-			strcat(chord, "minor 9th #11");
-			break;
-		case kmM9b11:
-			strcat(chord, "minor/maj 9th b11");
-			break;
-		case kMaj7b9:
-			strcat(chord, "major 7th b9");
-			break;
-		case kMaj7s5b9:
-			strcat(chord, "major 7th #5 b9");
-			break;
-		case kDom7b9:
-			strcat(chord, "dominant 7th b9");
-			break;
-		case kMin7b9:
-			strcat(chord, "minor 7th b9");
-			break;
-		case kMinb9s11:
-			strcat(chord, "minor b9 #11");
-			break;
-		case kHalfDimb9:
-			strcat(chord, "half diminished b9");
-			break;
-		case kDim7b9:
-			strcat(chord, "diminished b9");
-			break;
-		case kMinMajb9:
-			strcat(chord, "minor major b9");
-			break;
-		case kDimMajb9:
-			strcat(chord, "diminished M7 b9");
-			break;
-		case kMaj7s9:
-			strcat(chord, "major 7th #9");
-			break;
-		case kDom7s9:
-			strcat(chord, "dominant #9");
-			break;
-		case kMaj7s11:
-			strcat(chord, "major 7th #11");
-			break;
-		case kMaj9s13:
-			strcat(chord, "major 9th #13");
-			break;
-		case kMs9s11:
-			strcat(chord, "major #9 #11");
-			break;
-		case kHDimb11:
-			strcat(chord, "half diminished b11");
-			break;
-		case kMaj11:
-			strcat(chord, "major 11th");
-			break;
-		case kDom11:
-			strcat(chord, "dominant 11th");
-			break;
-		case kMin11:
-			strcat(chord, "minor 11th");
-			break;
-		case kHalfDim11:
-			strcat(chord, "half diminished 11th");
-			break;
-		case kDim11:
-			strcat(chord, "diminished 11th");
-			break;
-		case kMinMaj11:
-			strcat(chord, "minor major 11th");
-			break;
-		case kDimMaj11:
-			strcat(chord, "diminished maj 11th");
-			break;
-		case kMaj11b5:
-			strcat(chord, "major 11th b5");
-			break;
-		case kMaj11s5:
-			strcat(chord, "major 11th #5");
-			break;
-		case kMaj11b9:
-			strcat(chord, "major 11th b9");
-			break;
-		case kMaj11s9:
-			strcat(chord, "major 11th #9");
-			break;
-		case kMaj11b13:
-			strcat(chord, "major 11th b13");
-			break;
-		case kMaj11s13:
-			strcat(chord, "major 11th #13");
-			break;
-		case kM11b5b9:
-			strcat(chord, "major 11th b5 b9");
-			break;
-		case kDom11b5:
-			strcat(chord, "dominant 11th b5");
-			break;
-		case kDom11b9:
-			strcat(chord, "dominant 11th b9");
-			break;
-		case kDom11s9:
-			strcat(chord, "dominant 11th #9");
-			break;
-		case kHalfDim11b9:
-			strcat(chord, "half dim 11th b9");
-			break;
-		case kDom7s11:
-			strcat(chord, "dominant #11");
-			break;
-		case kMin7s11:
-			strcat(chord, "minor 7th #11");
-			break;
-		case kDom13s11:
-			strcat(chord, "dominant 13th #11");
-			break;
-		case kM7b913:
-			strcat(chord, "major 7 b9 13");
-			break;
-		case kMaj7s13:
-			strcat(chord, "major 7th #13");
-			break;
-		case kM7b9s13:
-			strcat(chord, "major 7 b9 #13");
-			break;
-		case kDom7b13:
-			strcat(chord, "dominant 7th b13");
-			break;
-		case kChrom:
-			strcat(chord, "chromatic");
-			break;
-		case kNone:
-		default:
-			strcat(chord, "unknown");
-			break;
-		}
-
-		outlet_symbol(x->x_outchordname, gensym(chord));
+		chord = chord_name[x->x_chord_root == kXX ? kNoRoot : x->x_chord_root][x->x_chord_type];
+		shape = chord_shape[x->x_chord_root == kXX ? kNoRoot : x->x_chord_root][x->x_chord_type];
 	}
+
+	// FWN: Skip repeated chords if requested.
+	if (x->x_changesonly && chord == x->x_lastchord)
+		return;
+	x->x_lastchord = chord;
+
+	// FWN: In template mode, a chord without a shape is played with the shape of the
+	// best scoring chord that has one. Otherwise the last shape is left in place.
+	if (shape < 0 && x->x_chord_type != kDefault)
+		shape = x->x_mappedshape;
+
+	if (x->x_numcandidates)
+		outlet_list(x->x_outcandidates, &s_list, 2 * x->x_numcandidates, x->x_candidates);
+	if (shape >= 0)
+		outlet_list(x->x_outshape, &s_list, 4, chord_shape_atoms[shape]);
+	outlet_symbol(x->x_outchordname, chord);
 }
 
-static void chord_kick_out_member(t_chord *x, t_int number, t_int *members)
+/* FWN: Resolves a quintad or sextad that is not in the interval tables by
+ * removing its most dissonant member. The remaining set has a smaller mask, so
+ * chord_build_table() has already resolved it; no recursion or allocation is needed.
+ */
+static t_chord_entry chord_kick_out_member(int number, int *members)
 {
-	int *distances;
+	int distances[6]; /* only quintads and sextads are pruned */
 	int minDistance = 1000;
 	int badMember = 0;
 	int i, j, interval;
-
-	distances = getbytes(number * sizeof(int));
+	int mask = 0;
+	t_chord_entry entry;
 
 	for (i = 0; i < number; i++)
 	{
@@ -1697,142 +1642,525 @@ static void chord_kick_out_member(t_chord *x, t_int number, t_int *members)
 			badMember = i;
 		}
 	}
-	freebytes(distances, number * sizeof(int));
-	x->x_pc[members[badMember]] = 0;   // cancel out most dissonant member
-	chord_chord_finder(x, number - 1); // call chord finder again without it
-	x->x_pc[members[badMember]] = 1;   // replace most dissonant member
+
+	// look up the chord without the most dissonant member
+	for (i = 0; i < number; i++)
+		if (i != badMember)
+			mask |= 1 << members[i];
+	entry = chord_table[mask];
+	return (t_chord_entry)((entry & ~(0x03 << 13)) | ((ENTRY_DEPTH(entry) + 1) << 13));
 }
 
-static void chord_chord_finder(t_chord *x, t_int num_pcs)
+/* FWN: Resolves a pitch class set to its chord. Only used to fill chord_table[],
+ * which must already hold the entries for all smaller masks.
+ */
+static t_chord_entry chord_chord_finder(int mask)
 {
+	int members[12];
+	int num_pcs = 0;
 	int i;
-	x->x_chord_type = kNone;
-	x->x_chord_root = kXX; /* none */
+
+	for (i = 0; i < 12; i++)
+		if (mask & (1 << i))
+			members[num_pcs++] = i; /* load members array with chord pitch classes */
+
 	switch (num_pcs)
 	{
 	case 0:
-		chord_default(x);
-		break;
+		return chord_pack(kDefault, kNoRoot, 0);
 	case 1:
-		chord_unison(x);
-		break;
+		return chord_unison(members);
 	case 2:
-		chord_dyad(x);
-		break;
+		return chord_dyad(members);
 	case 3:
-		chord_triad(x);
-		break;
+		return chord_triad(members);
 	case 4:
-		chord_quartad(x);
-		break;
+		return chord_quartad(members);
 	case 5:
-		chord_quintad(x);
-		break;
+		return chord_quintad(members);
 	case 6:
-		chord_sextad(x);
-		break;
+		return chord_sextad(members);
 	default:
-		x->x_chord_type = kChrom;
-		for (i = 0; i < 12; i++) // 12 was num_pcs !?
+		return chord_pack(kChrom, members[0], 0);
+	}
+}
+
+static void chord_build_table(void)
+{
+	char chord[255]; /* chord name */
+	int mask, root, type;
+
+	/* ascending order resolves every subset of a mask before the mask itself */
+	for (mask = 0; mask < NUM_PC_SETS; mask++)
+		chord_table[mask] = chord_chord_finder(mask);
+
+	for (root = 0; root < 13; root++)
+		for (type = 0; type < kDefault; type++)
 		{
-			if (x->x_pc[i])
+			snprintf(chord, sizeof(chord), "%s%s", pitch_class[root], chord_type_name[type]);
+			chord_name[root][type] = gensym(chord);
+			chord_shape[root][type] = -1;
+		}
+}
+
+/* FWN: Derives the template of every chord type from the chords that the table finds
+ * without kicking out members, so that both modes agree on what a chord contains.
+ */
+static void chord_build_templates(void)
+{
+	int mask, type, root, pc;
+
+	for (mask = 1; mask < NUM_PC_SETS; mask++)
+	{
+		type = ENTRY_TYPE(chord_table[mask]);
+		root = ENTRY_ROOT(chord_table[mask]);
+		if (type < NUM_TEMPLATES && root != kNoRoot && !ENTRY_DEPTH(chord_table[mask]))
+			chord_template_mask[type] |= ((mask >> root) | (mask << (12 - root))) & 0xfff;
+	}
+	for (type = 0; type < NUM_TEMPLATES; type++)
+	{
+		int members = 0;
+		for (pc = 0; pc < 12; pc++)
+			if (chord_template_mask[type] & (1 << pc))
 			{
-				x->x_chord_root = i;
-				break;
+				chord_template[type][pc] = 1;
+				members++;
 			}
-		}
+		chord_template_norm[type] = members ? 1 / sqrtf((float)members) : 0;
 	}
 }
 
-static void chord_float(t_chord *x, t_floatarg f)
+static void chord_build_shapes(void)
 {
-	t_int velo = x->x_velo;
-	t_int num_pc = 0; /* number of pitch classes present */
-	int i;
+	t_symbol *name;
+	int i, j, root, type, found;
 
-	x->x_pitch = (t_int)f;
+	for (i = 0; i < NUM_CHORD_SHAPES; i++)
+		for (j = 0; j < 4; j++)
+			SETSYMBOL(&chord_shape_atoms[i][j], gensym(chord_shape_notes[i][j]));
 
-	// FWN: Check if the note is within the specified note range (inclusive). Notes outside of the range are ignored.
-	if (x->x_pitch >= x->x_lowerlimit && x->x_pitch <= x->x_upperlimit)
+	for (i = 0; i < NUM_CHORD_SHAPE_NAMES; i++)
 	{
-		/* first we need to put the note into the allocation table */
-		if (velo == 0) /* got note-off: remove from allocation table */
-		{
-			if (x->x_poly > 0)
-				x->x_poly--;			   /* polyphony has decreased by one */
-			for (i = 0; i < MAX_POLY; i++) /* search for voice allocation number */
-			{
-				/* search for corresponding alloc number */
-				if (x->x_alloctable[i] == x->x_pitch)
-				{
-					x->x_alloctable[i] = -1; /* free the alloc number */
-					break;
-				}
-				/* couldn't find it ? */
-				if (i == MAX_POLY - 1)
+		name = gensym(chord_shape_names[i]);
+		found = 0;
+		for (root = 0; root < 13; root++)
+			for (type = 0; type < kDefault; type++)
+				if (chord_name[root][type] == name)
 				{
-					post("chord: no corresponding note-on found (ignored)");
-					return;
+					chord_shape[root][type] = chord_shape_index[i];
+					found = 1;
 				}
-			}
-		}
-		else /* we got a note-on message */
-		{
-			if (x->x_poly == MAX_POLY)
+		if (!found)
+			post("chord: shape for unknown chord %s (ignored)", chord_shape_names[i]);
+	}
+}
+
+/* FWN: Adds a note to the note state. Returns 0 if the note was already playing. */
+static int chord_note_on(t_chord *x, int pitch, int velo)
+{
+	unsigned int bit = 1u << (pitch & 31);
+	int pc = pitch % 12;
+
+	x->x_velocity[pitch] = (unsigned char)(velo < 1 ? 1 : velo > 127 ? 127 : velo);
+	if (x->x_notes[pitch >> 5] & bit)
+		return 0;
+	x->x_notes[pitch >> 5] |= bit;
+	x->x_poly++; /* number of currently playing notes has increased */
+
+	if (x->x_pc[pc]++ == 0) /* a new pitch class */
+	{
+		x->x_pcmask |= 1 << pc;
+		x->x_numpc++;
+		x->x_abs_pc[pc] = pitch;
+	}
+	else if (x->x_abs_pc[pc] > pitch) /* remember lowest pitch */
+		x->x_abs_pc[pc] = pitch;
+
+	if (x->x_chord_bass == kXX || x->x_chord_bass > pitch)
+		x->x_chord_bass = pitch;
+	return 1;
+}
+
+/* FWN: Removes a note from the note state. Returns 0 if the note was not playing. */
+static int chord_note_off(t_chord *x, int pitch)
+{
+	unsigned int bit = 1u << (pitch & 31);
+	int pc = pitch % 12;
+	int i;
+
+	if (!(x->x_notes[pitch >> 5] & bit))
+		return 0;
+	x->x_notes[pitch >> 5] &= ~bit;
+	x->x_poly--; /* polyphony has decreased by one */
+
+	if (--x->x_pc[pc] == 0) /* pitch class is gone */
+	{
+		x->x_pcmask &= ~(1 << pc);
+		x->x_numpc--;
+		x->x_abs_pc[pc] = kXX;
+	}
+	else if (x->x_abs_pc[pc] == pitch) /* find the next lowest pitch in this pitch class */
+	{
+		for (i = pitch + 12; i < NUM_NOTES; i += 12)
+			if (x->x_notes[i >> 5] & (1u << (i & 31)))
 			{
-				post("chord: too many note-on messages (ignored)");
-				return;
+				x->x_abs_pc[pc] = i;
+				break;
 			}
+	}
+
+	if (x->x_chord_bass == pitch) /* the bass is the lowest of the pitch classes' lowest notes */
+	{
+		x->x_chord_bass = kXX;
+		for (i = 0; i < 12; i++)
+			if (x->x_pc[i] && (x->x_chord_bass == kXX || x->x_chord_bass > x->x_abs_pc[i]))
+				x->x_chord_bass = x->x_abs_pc[i];
+	}
+	return 1;
+}
+
+/* FWN: Scores the playing notes against every chord type in every root: the cosine of
+ * the velocity-weighted pitch classes and the template, plus kBassWeight if the root is
+ * the lowest note. An exact match in root position scores 1. Finds the best x_topk
+ * chords and the best chord that has a shape.
+ */
+static void chord_score(t_chord *x)
+{
+	float weight[12] = {0};
+	float rotated[12][NUM_ROOTS]; /* rotated[k][root]: weight of the pitch class k above root */
+	float bassbonus[NUM_ROOTS] = {0};
+	float score[NUM_TEMPLATES * NUM_ROOTS];
+	int best[MAX_CANDIDATES];
+	int numbest = 0, maxbest = x->x_topk < 1 ? 1 : x->x_topk;
+	int mapped = -1;
+	float norm = 0, scale, acc[NUM_ROOTS];
+	int i, j, k, pitch, type, root, bass;
+
+	if (!x->x_numpc)
+	{
+		x->x_chord_type = kDefault;
+		x->x_chord_root = kXX;
+		x->x_chord_inversion = 0;
+		x->x_numcandidates = 0;
+		x->x_mappedshape = -1;
+		return;
+	}
+
+	/* loudest note of every pitch class */
+	for (pitch = 0; pitch < NUM_NOTES; pitch++)
+		if ((x->x_notes[pitch >> 5] & (1u << (pitch & 31))) && weight[pitch % 12] < x->x_velocity[pitch])
+			weight[pitch % 12] = x->x_velocity[pitch];
+	for (i = 0; i < 12; i++)
+		norm += weight[i] * weight[i];
+	scale = (1 - kBassWeight) / sqrtf(norm);
 
-			x->x_poly++; /* number of currently playing notes has increased */
-			/* assign a voice allocation number */
-			for (i = 0; i < MAX_POLY; i++)
+	for (k = 0; k < 12; k++)
+		for (root = 0; root < NUM_ROOTS; root++)
+			rotated[k][root] = root < 12 ? weight[(k + root) % 12] * scale : 0;
+	bass = x->x_chord_bass % 12;
+	bassbonus[bass] = kBassWeight;
+
+	/* all roots of a chord type at once: the inner loops have no branches and vectorize */
+	for (type = 0; type < NUM_TEMPLATES; type++)
+	{
+		for (root = 0; root < NUM_ROOTS; root++)
+			acc[root] = 0;
+		for (k = 0; k < 12; k++)
+			if (chord_template_mask[type] & (1 << k))
+				for (root = 0; root < NUM_ROOTS; root++)
+					acc[root] += rotated[k][root];
+		for (root = 0; root < NUM_ROOTS; root++)
+			score[type * NUM_ROOTS + root] = acc[root] * chord_template_norm[type] + bassbonus[root];
+	}
+
+	/* keep the best chords in order, the simpler chord first when scores are equal */
+	for (type = 0; type < NUM_TEMPLATES; type++)
+		for (root = 0; root < 12; root++)
+		{
+			i = type * NUM_ROOTS + root;
+			if (numbest < maxbest || score[i] > score[best[numbest - 1]])
 			{
-				/* search for free alloc number */
-				if (x->x_alloctable[i] == -1)
-				{
-					x->x_alloctable[i] = x->x_pitch; /* ... and store pitch */
-					break;
-				}
+				j = numbest < maxbest ? numbest++ : numbest - 1;
+				for (; j > 0 && score[best[j - 1]] < score[i]; j--)
+					best[j] = best[j - 1];
+				best[j] = i;
 			}
-		}
+			if (chord_shape[root][type] >= 0 && (mapped < 0 || score[i] > score[mapped]))
+				mapped = i;
+		}
+
+	x->x_chord_type = best[0] / NUM_ROOTS;
+	x->x_chord_root = best[0] % NUM_ROOTS;
+	/* inversion: number of chord members between the root and the bass */
+	x->x_chord_inversion = 0;
+	for (k = 0; k < (bass - x->x_chord_root + 12) % 12; k++)
+		if (chord_template_mask[x->x_chord_type] & (1 << k))
+			x->x_chord_inversion++;
+	if (x->x_chord_inversion > 3)
+		x->x_chord_inversion = 3;
+
+	x->x_numcandidates = x->x_topk < numbest ? x->x_topk : numbest;
+	for (i = 0; i < x->x_numcandidates; i++)
+	{
+		SETSYMBOL(&x->x_candidates[2 * i], chord_name[best[i] % NUM_ROOTS][best[i] / NUM_ROOTS]);
+		SETFLOAT(&x->x_candidates[2 * i + 1], score[best[i]]);
+	}
+	x->x_mappedshape = mapped < 0 ? -1 : chord_shape[mapped % NUM_ROOTS][mapped / NUM_ROOTS];
+}
 
-		/* copy all notes into the pitch class array */
-		for (i = 0; i < 12; i++)
+/* FWN: Monotonic time in microseconds, for the detection time statistics. */
+static double chord_now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, frequency;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&frequency);
+	return (double)count.QuadPart * 1e6 / (double)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+#endif
+}
+
+static void chord_detect(t_chord *x)
+{
+	t_chord_entry entry = chord_table[x->x_pcmask];
+	t_chord_stats *stats = &x->x_stats;
+	double start = chord_now(), time;
+
+	x->x_pending = 0;
+	if (x->x_mode == kTemplateMode)
+		chord_score(x);
+	else
+	{
+		x->x_chord_type = ENTRY_TYPE(entry);
+		x->x_chord_root = ENTRY_ROOT(entry) == kNoRoot ? kXX : ENTRY_ROOT(entry);
+		x->x_chord_inversion = ENTRY_INVERSION(entry);
+		if (ENTRY_DEPTH(entry))
+			stats->fallbacks++;
+		else
+			stats->hits++;
+		if (stats->maxdepth < ENTRY_DEPTH(entry))
+			stats->maxdepth = ENTRY_DEPTH(entry);
+	}
+
+	time = chord_now() - start;
+	if (!stats->detections++ || time < stats->mintime)
+		stats->mintime = time;
+	if (time > stats->maxtime)
+		stats->maxtime = time;
+	stats->totaltime += time;
+
+	// FWN: Hold released chords back until no note-off has arrived for the hold time,
+	// so that letting go of a chord one note at a time does not output every step.
+	if (!x->x_noteon && x->x_hold > 0)
+		clock_delay(x->x_holdclock, x->x_hold);
+	else
+	{
+		clock_unset(x->x_holdclock);
+		chord_draw_chord_type(x); /* output onto the screen */
+	}
+	x->x_noteon = 0;
+}
+
+// FWN: Notes of a chord arrive as separate messages at the same logical time, so
+// detection is deferred until all of them (or all within the coalescing time) are in.
+static void chord_schedule(t_chord *x)
+{
+	if (x->x_coalesce < 0)
+		chord_detect(x);
+	else if (!x->x_pending)
+	{
+		x->x_pending = 1;
+		clock_delay(x->x_detectclock, x->x_coalesce);
+	}
+}
+
+/* FWN: Updates the note state for one note. Returns 1 if the note was used. */
+static int chord_note(t_chord *x, int pitch, int velo)
+{
+	x->x_stats.events++;
+
+	// FWN: Check if the note is within the specified note range (inclusive). Notes outside of the range are ignored.
+	if (pitch < x->x_lowerlimit || pitch > x->x_upperlimit || pitch < 0 || pitch >= NUM_NOTES)
+	{
+		x->x_stats.ignored++;
+		return 0;
+	}
+
+	if (velo == 0) /* got note-off: remove from note state */
+	{
+		if (!chord_note_off(x, pitch))
 		{
-			x->x_pc[i] = 0;		 /* empty pitch class */
-			x->x_abs_pc[i] = -1; /* empty absolute values */
+			post("chord: no corresponding note-on found (ignored)");
+			x->x_stats.droppedoff++;
+			return 0;
 		}
-		for (i = 0; i < MAX_POLY; i++)
-		{
-			/* check for presence of pitch class */
-			if (x->x_alloctable[i] != -1)
-			{
-				if (!x->x_pc[x->x_alloctable[i] % 12]) /* a new pitch class */
-				{
-					x->x_abs_pc[x->x_alloctable[i] % 12] = x->x_alloctable[i];
-				}
-				else if (x->x_abs_pc[x->x_alloctable[i] % 12] > x->x_alloctable[i]) /* remember lowest pitch */
-				{
-					x->x_abs_pc[x->x_alloctable[i] % 12] = x->x_alloctable[i];
-				}
+	}
+	else /* we got a note-on message */
+	{
+		if (!chord_note_on(x, pitch, velo))
+			x->x_stats.droppedon++;
+		x->x_noteon = 1;
+	}
+	return 1;
+}
 
-				x->x_pc[x->x_alloctable[i] % 12] = 1; /* indicate presence of pc */
-			}
+static void chord_float(t_chord *x, t_floatarg f)
+{
+	if (chord_note(x, (int)f, x->x_velo))
+		chord_schedule(x);
+}
+
+// FWN: A list of pitch/velocity pairs, e.g. "60 100 64 100 67 100". The notes are
+// applied in order and the chord is detected once for all of them.
+static void chord_list(t_chord *x, t_symbol *s, int argc, t_atom *argv)
+{
+	int i, changed = 0;
+
+	(void)s;
+	if (argc == 1) /* a single pitch, like a float */
+	{
+		chord_float(x, atom_getfloat(argv));
+		return;
+	}
+	if (argc & 1)
+	{
+		pd_error(x, "chord: list needs pitch/velocity pairs");
+		return;
+	}
+	for (i = 0; i < argc; i += 2)
+	{
+		x->x_velo = (int)atom_getfloat(argv + i + 1); /* like setting the right inlet */
+		changed |= chord_note(x, (int)atom_getfloat(argv + i), x->x_velo);
+	}
+	if (changed)
+		chord_schedule(x);
+}
+
+// FWN: "chord <pitch> ..." replaces the playing notes with the given ones, and detects
+// the chord once. "chord" without pitches releases all notes.
+static void chord_chord(t_chord *x, t_symbol *s, int argc, t_atom *argv)
+{
+	unsigned int notes[NUM_NOTES / 32] = {0};
+	int i, pitch, changed = 0;
+
+	(void)s;
+	for (i = 0; i < argc; i++)
+	{
+		pitch = (int)atom_getfloat(argv + i);
+		if (pitch >= x->x_lowerlimit && pitch <= x->x_upperlimit && pitch >= 0 && pitch < NUM_NOTES)
+			notes[pitch >> 5] |= 1u << (pitch & 31);
+		else
+			x->x_stats.ignored++;
+	}
+	for (pitch = 0; pitch < NUM_NOTES; pitch++)
+	{
+		unsigned int bit = 1u << (pitch & 31);
+
+		if ((x->x_notes[pitch >> 5] & bit) && !(notes[pitch >> 5] & bit))
+		{
+			changed |= chord_note_off(x, pitch);
+			x->x_stats.events++;
 		}
-		/* count number of pitch classes */
-		for (i = 0; i < 12; i++)
+		else if (!(x->x_notes[pitch >> 5] & bit) && (notes[pitch >> 5] & bit))
 		{
-			num_pc += x->x_pc[i];
+			changed |= chord_note_on(x, pitch, 127);
+			x->x_noteon = 1;
+			x->x_stats.events++;
 		}
-
-		chord_chord_finder(x, num_pc);
 	}
+	if (changed)
+		chord_schedule(x);
+}
+
+static void chord_hold_tick(t_chord *x)
+{
+	chord_draw_chord_type(x);
 }
 
 static void chord_ft1(t_chord *x, t_floatarg f)
 {
-	x->x_velo = (t_int)f;
+	x->x_velo = (int)f;
+}
+
+// FWN: Only output a chord when it differs from the last one (1) or always (0).
+static void chord_changes(t_chord *x, t_floatarg f)
+{
+	x->x_changesonly = (f != 0);
+}
+
+// FWN: Set the time in ms to hold a released chord (0 to output immediately).
+static void chord_hold(t_chord *x, t_floatarg f)
+{
+	x->x_hold = (f < 0 ? 0 : f);
+}
+
+// FWN: Set the time in ms to collect notes before detecting the chord. 0 waits for the
+// end of the current logical time, a negative value detects the chord on every note.
+static void chord_coalesce(t_chord *x, t_floatarg f)
+{
+	x->x_coalesce = f;
+	if (x->x_coalesce < 0 && x->x_pending)
+	{
+		clock_unset(x->x_detectclock);
+		chord_detect(x);
+	}
+}
+
+// FWN: "mode table" looks the chord up (the default), "mode template" scores the notes
+// against every chord and also reports the best ones with their scores.
+static void chord_mode(t_chord *x, t_symbol *s)
+{
+	if (s == gensym("table"))
+		x->x_mode = kTableMode;
+	else if (s == gensym("template"))
+		x->x_mode = kTemplateMode;
+	else
+		pd_error(x, "chord: unknown mode %s (use table or template)", s->s_name);
+	x->x_numcandidates = 0;
+	x->x_mappedshape = -1;
+}
+
+// FWN: Set the number of chords to report in template mode (0 to report none).
+static void chord_topk(t_chord *x, t_floatarg f)
+{
+	x->x_topk = f < 0 ? 0 : f > MAX_CANDIDATES ? MAX_CANDIDATES : (int)f;
+}
+
+// FWN: Report the statistics out of the right outlet, one message per counter, e.g.
+// "detections 120" or "time 0.1 0.2 3.5" (minimum, mean and maximum in microseconds).
+static void chord_stats(t_chord *x)
+{
+	t_chord_stats *stats = &x->x_stats;
+	t_atom a[3];
+
+	SETFLOAT(&a[0], stats->events);
+	outlet_anything(x->x_outinfo, gensym("events"), 1, a);
+	SETFLOAT(&a[0], stats->detections);
+	outlet_anything(x->x_outinfo, gensym("detections"), 1, a);
+	SETFLOAT(&a[0], stats->hits);
+	outlet_anything(x->x_outinfo, gensym("hits"), 1, a);
+	SETFLOAT(&a[0], stats->fallbacks);
+	outlet_anything(x->x_outinfo, gensym("fallbacks"), 1, a);
+	SETFLOAT(&a[0], stats->maxdepth);
+	outlet_anything(x->x_outinfo, gensym("depth"), 1, a);
+	SETFLOAT(&a[0], stats->droppedon);
+	SETFLOAT(&a[1], stats->droppedoff);
+	outlet_anything(x->x_outinfo, gensym("dropped"), 2, a);
+	SETFLOAT(&a[0], stats->ignored);
+	outlet_anything(x->x_outinfo, gensym("ignored"), 1, a);
+	SETFLOAT(&a[0], stats->mintime);
+	SETFLOAT(&a[1], stats->detections ? stats->totaltime / stats->detections : 0);
+	SETFLOAT(&a[2], stats->maxtime);
+	outlet_anything(x->x_outinfo, gensym("time"), 3, a);
+}
+
+// FWN: Clear the statistics.
+static void chord_reset(t_chord *x)
+{
+	memset(&x->x_stats, 0, sizeof(x->x_stats));
 }
 
 static t_class *chord_class;
@@ -1844,22 +2172,51 @@ static void *chord_new(t_floatarg f1, t_floatarg f2)
 	x->x_invelo = inlet_new(&x->x_ob, &x->x_ob.ob_pd, gensym("float"), gensym("ft1"));
 	x->x_indefaultchord = symbolinlet_new(&x->x_ob, &x->x_defaultchord);
 	x->x_outchordname = outlet_new(&x->x_ob, gensym("symbol"));
+	x->x_outshape = outlet_new(&x->x_ob, gensym("list"));
+	x->x_outcandidates = outlet_new(&x->x_ob, gensym("list"));
+	x->x_outinfo = outlet_new(&x->x_ob, 0);
 
-	x->x_lowerlimit = (t_int)f1;
-	x->x_upperlimit = (t_int)f2;
+	x->x_lowerlimit = (int)f1;
+	x->x_upperlimit = (int)f2;
 
 	if (x->x_upperlimit == 0)
 		x->x_upperlimit = 128;
 
-	for (int i = 0; i < MAX_POLY; i++)
-		x->x_alloctable[i] = -1;
+	for (int i = 0; i < 12; i++)
+		x->x_abs_pc[i] = kXX;
+	x->x_chord_bass = kXX;
+	x->x_defaultshape = -1;
+	x->x_mappedshape = -1;
+	x->x_topk = 3;
+
+	x->x_holdclock = clock_new(x, (t_method)chord_hold_tick);
+	x->x_detectclock = clock_new(x, (t_method)chord_detect);
 
 	return (void *)x;
 }
 
+static void chord_free(t_chord *x)
+{
+	clock_free(x->x_holdclock);
+	clock_free(x->x_detectclock);
+}
+
 void notchord_setup(void)
 {
-	chord_class = class_new(gensym("notchord"), (t_newmethod)chord_new, 0, sizeof(t_chord), 0, A_DEFFLOAT, A_DEFFLOAT, 0);
+	chord_class = class_new(gensym("notchord"), (t_newmethod)chord_new, (t_method)chord_free, sizeof(t_chord), 0, A_DEFFLOAT, A_DEFFLOAT, 0);
 	class_addfloat(chord_class, chord_float);
+	class_addlist(chord_class, chord_list);
+	class_addmethod(chord_class, (t_method)chord_chord, gensym("chord"), A_GIMME, 0);
 	class_addmethod(chord_class, (t_method)chord_ft1, gensym("ft1"), A_FLOAT, 0);
+	class_addmethod(chord_class, (t_method)chord_changes, gensym("changes"), A_FLOAT, 0);
+	class_addmethod(chord_class, (t_method)chord_hold, gensym("hold"), A_FLOAT, 0);
+	class_addmethod(chord_class, (t_method)chord_coalesce, gensym("coalesce"), A_FLOAT, 0);
+	class_addmethod(chord_class, (t_method)chord_mode, gensym("mode"), A_SYMBOL, 0);
+	class_addmethod(chord_class, (t_method)chord_topk, gensym("topk"), A_FLOAT, 0);
+	class_addmethod(chord_class, (t_method)chord_stats, gensym("stats"), 0);
+	class_addmethod(chord_class, (t_method)chord_reset, gensym("reset"), 0);
+
+	chord_build_table();
+	chord_build_templates();
+	chord_build_shapes();
 }
@@ -0,0 +1,94 @@
+/* ------------------------- pdfiles ------------------------------------------ */
+/*                                                                              */
+/* Lists the files of a directory and hashes symbols, for the objects that load */
+/* a directory of files into a table: chordcache and sampler~.                  */
+/* Written by Francois W. Nel for the Ukulele patch for Organelle.              */
+/*                                                                              */
+/* This program is free software: you can redistribute it and/or modify        */
+/* it under the terms of the GNU General Public License as published by        */
+/* the Free Software Foundation, either version 3 of the License, or           */
+/* (at your option) any later version.                                          */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,             */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of              */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               */
+/* GNU General Public License for more details.                                */
+/*                                                                              */
+/* You should have received a copy of the GNU General Public License           */
+/* along with this program.  If not, see <https://www.gnu.org/licenses/>.      */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#ifndef PDFILES_H
+#define PDFILES_H
+
+#include "m_pd.h"
+#include <stddef.h>
+#include <stdio.h>
+#ifdef _WIN32
+#include <io.h>
+#include <stdint.h>
+#else
+#include <dirent.h>
+#endif
+
+typedef struct
+{
+#ifdef _WIN32
+	intptr_t d_handle;
+	struct _finddata_t d_file;
+	int d_first; /* set until the first file has been returned */
+#else
+	DIR *d_dir;
+#endif
+} t_pdfiles_dir;
+
+/* Opens <dir> to list its files. On Windows only the files ending in <extension> (such
+ * as ".wav") are listed; elsewhere all of them are, so check the names that come back.
+ */
+static inline int pdfiles_opendir(t_pdfiles_dir *d, const char *dir, const char *extension)
+{
+#ifdef _WIN32
+	char pattern[MAXPDSTRING];
+	if (snprintf(pattern, sizeof(pattern), "%s/*%s", dir, extension) >= (int)sizeof(pattern))
+		return 0;
+	d->d_first = 1;
+	return (d->d_handle = _findfirst(pattern, &d->d_file)) != -1;
+#else
+	(void)extension;
+	return (d->d_dir = opendir(dir)) != 0;
+#endif
+}
+
+/* Returns the name of the next file in the directory, or NULL at the end. */
+static inline const char *pdfiles_readdir(t_pdfiles_dir *d)
+{
+#ifdef _WIN32
+	if (!d->d_first && _findnext(d->d_handle, &d->d_file) != 0)
+		return 0;
+	d->d_first = 0;
+	return d->d_file.name;
+#else
+	struct dirent *file = readdir(d->d_dir);
+	return file ? file->d_name : 0;
+#endif
+}
+
+static inline void pdfiles_closedir(t_pdfiles_dir *d)
+{
+#ifdef _WIN32
+	_findclose(d->d_handle);
+#else
+	closedir(d->d_dir);
+#endif
+}
+
+/* The slot of an open addressing table for a symbol. Symbols are unique, so their
+ * address is a good key; the low bits are always 0 and are shifted out.
+ */
+static inline unsigned int pdfiles_hash(t_symbol *s)
+{
+	return (unsigned int)(((size_t)s >> 3) * 2654435761u);
+}
+
+#endif
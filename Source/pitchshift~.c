@@ -0,0 +1,217 @@
+/* ------------------------- pitchshift~ -------------------------------------- */
+/*                                                                              */
+/* Tunes a string up or down by up to a tone, replacing the tuner abstraction.  */
+/* Written by Francois W. Nel for the Ukulele patch for Organelle.              */
+/*                                                                              */
+/* This program is free software: you can redistribute it and/or modify        */
+/* it under the terms of the GNU General Public License as published by        */
+/* the Free Software Foundation, either version 3 of the License, or           */
+/* (at your option) any later version.                                          */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,             */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of              */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               */
+/* GNU General Public License for more details.                                */
+/*                                                                              */
+/* You should have received a copy of the GNU General Public License           */
+/* along with this program.  If not, see <https://www.gnu.org/licenses/>.      */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#include "m_pd.h"
+#include <math.h>
+#include <string.h>
+
+/* Version: pitchshift~ v0.1
+ * The same shifter as the tuner abstraction that it replaces, which is the one of Pd's
+ * G09.pitchshift example: two taps read a delay line kWindow ms long, half a window
+ * apart, and move through it at the rate that gives the transposition. Each tap is
+ * faded in and out with half a cosine, so that one is silent whenever the other jumps
+ * back, and the taps are read with the 4-point interpolation of vd~.
+ *
+ * Usage: [pitchshift~], with the string in the left inlet and a knob (0 to 1) in the
+ * right inlet, which tunes the string from kRange semitones down to kRange semitones
+ * up. Like the tuner did, the knob is ignored until it has passed the middle, so a
+ * string isn't detuned by where the knob happened to be when the patch was opened.
+ * "tune <semitones>" sets the transposition directly.
+ *
+ * FWN: The delay line only holds a window and the block, rounded up to a power of two:
+ * 8192 samples at 48 kHz, where every tuner had a 5 second delwrite~. The transposition
+ * glides to a new knob value over about kGlideTime ms, instead of stepping once a block.
+ * The taps and their gains are computed kChunk samples at a time first, in loops
+ * without a branch that the compiler vectorizes, and the delay line is read after them.
+ *
+ * FWN: Once the input has been below kSilence for as long as the delay line, the output
+ * is silent too, and pitchshift~ only checks the input until the string sounds again.
+ */
+
+#define kWindow 100.f	 /* ms of the delay line that each tap sweeps */
+#define kDelay 1.5f		 /* ms that the taps stay behind the input */
+#define kRange 2.f		 /* semitones up or down at the ends of the knob */
+#define kGlideTime 30.f	 /* ms for the transposition to follow the knob */
+#define kCatchLow 0.48f	 /* the knob is taken over once it is between these */
+#define kCatchHigh 0.52f
+
+#define kChunk 64 /* samples that the taps are computed for at once */
+#define kSilence 1e-5f /* -100 dB, below which the input is silent */
+
+typedef struct pitchshift
+{
+	t_object x_ob;
+	t_float x_f;
+
+	t_float x_sr;
+	int x_caught; /* whether the knob has passed the middle */
+
+	double x_phase;	  /* of the first tap, from 0 to 1 */
+	t_float x_freq;	  /* of the phase, in Hz */
+	t_float x_target; /* that x_freq glides to */
+
+	t_sample *x_buf; /* the delay line */
+	int x_size;		 /* a power of two */
+	int x_write;	 /* where the next input sample goes */
+	int x_quiet;	 /* samples that the input has been silent for, up to x_size */
+} t_pitchshift;
+
+static t_class *pitchshift_class;
+
+/* FWN: sin(pi * p) for p between 0 and 1, as the Taylor series of cos(pi * q) in q * q,
+ * with q = p - 0.5, which is what cos~ computes in the tuner. The error is below 1e-6.
+ */
+static inline t_sample pitchshift_window(t_sample p)
+{
+	t_sample s = (p - 0.5f) * (p - 0.5f);
+
+	return 1 + s * (-4.9348022f + s * (4.0587121f + s * (-1.3352627f + s * (0.2353306f + s * -0.0258069f))));
+}
+
+/* The phase frequency for a transposition: the taps fall behind (or catch up with) the
+ * input by the ratio of the frequencies less 1, a window every period.
+ */
+static t_float pitchshift_freq(t_float semitones)
+{
+	return -(powf(2, semitones / 12) - 1) / (kWindow * 0.001f);
+}
+
+static void pitchshift_tune(t_pitchshift *x, t_floatarg semitones)
+{
+	x->x_target = pitchshift_freq(semitones);
+}
+
+static void pitchshift_knob(t_pitchshift *x, t_floatarg f)
+{
+	if (!x->x_caught && f > kCatchLow && f < kCatchHigh)
+		x->x_caught = 1;
+	if (x->x_caught)
+		pitchshift_tune(x, (f * 2 - 1) * kRange);
+}
+
+static t_int *pitchshift_perform(t_int *w)
+{
+	t_pitchshift *x = (t_pitchshift *)(w[1]);
+	t_sample *in = (t_sample *)(w[2]);
+	t_sample *out = (t_sample *)(w[3]);
+	int n = (int)(w[4]);
+	t_sample delay[2][kChunk], gain[2][kChunk], *buf = x->x_buf;
+	t_sample window = kWindow * 0.001f * x->x_sr, offset = kDelay * 0.001f * x->x_sr;
+	t_sample step, start, p, frac, a, b, c, d, cminusb, sum;
+	int mask = x->x_size - 1, done, m, i, t, index, pos, loud = 0;
+
+	for (i = 0; i < n; i++)
+		loud |= (fabsf(in[i]) >= kSilence);
+	if (!loud && x->x_quiet >= x->x_size)
+	{
+		for (i = 0; i < n; i++)
+			out[i] = 0;
+		return (w + 5);
+	}
+	if (loud && x->x_quiet >= x->x_size)
+		memset(buf, 0, x->x_size * sizeof(t_sample)); /* forget what was below kSilence */
+	x->x_quiet = loud ? 0 : x->x_quiet + n;
+
+	// FWN: Glide once a block, which is smooth enough for a frequency of a few Hz.
+	x->x_freq += (x->x_target - x->x_freq) * (1 - expf(-1000.f * n / (kGlideTime * x->x_sr)));
+	step = x->x_freq / x->x_sr;
+
+	for (done = 0; done < n; done += m)
+	{
+		m = n - done < kChunk ? n - done : kChunk;
+		start = (t_sample)x->x_phase;
+		for (t = 0; t < 2; t++)
+			for (i = 0; i < m; i++)
+			{
+				p = start + t * 0.5f + (i + 1) * step;
+				p -= floorf(p);
+				delay[t][i] = p * window + offset;
+				gain[t][i] = pitchshift_window(p);
+			}
+		x->x_phase += m * (double)step;
+		x->x_phase -= floor(x->x_phase);
+
+		// FWN: Read like vd~ does, between the samples <index> and <index> + 1 before the input.
+		for (i = 0; i < m; i++)
+		{
+			buf[x->x_write] = in[done + i];
+			for (t = 0, sum = 0; t < 2; t++)
+			{
+				index = (int)delay[t][i];
+				frac = delay[t][i] - index;
+				pos = x->x_write - index;
+				a = buf[(pos + 1) & mask];
+				b = buf[pos & mask];
+				c = buf[(pos - 1) & mask];
+				d = buf[(pos - 2) & mask];
+				cminusb = c - b;
+				sum += gain[t][i] * (b + frac * (cminusb - 0.1666667f * (1.f - frac) * ((d - a - 3.0f * cminusb) * frac + (d + 2.0f * a - 3.0f * b))));
+			}
+			out[done + i] = sum;
+			x->x_write = (x->x_write + 1) & mask;
+		}
+	}
+	return (w + 5);
+}
+
+static void pitchshift_dsp(t_pitchshift *x, t_signal **sp)
+{
+	int n = sp[0]->s_n, size = 1;
+
+	x->x_sr = sp[0]->s_sr;
+	while (size < (kWindow + kDelay) * 0.001f * x->x_sr + n + 4)
+		size *= 2;
+	if (size != x->x_size)
+	{
+		if (x->x_buf)
+			freebytes(x->x_buf, x->x_size * sizeof(t_sample));
+		x->x_buf = (t_sample *)getbytes(size * sizeof(t_sample));
+		x->x_size = size;
+		x->x_write = 0;
+		x->x_quiet = 0;
+	}
+	dsp_add(pitchshift_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, (t_int)n);
+}
+
+static void *pitchshift_new(void)
+{
+	t_pitchshift *x = (t_pitchshift *)pd_new(pitchshift_class);
+
+	inlet_new(&x->x_ob, &x->x_ob.ob_pd, &s_float, gensym("knob"));
+	outlet_new(&x->x_ob, &s_signal);
+	x->x_sr = sys_getsr();
+
+	return (void *)x;
+}
+
+static void pitchshift_free(t_pitchshift *x)
+{
+	if (x->x_buf)
+		freebytes(x->x_buf, x->x_size * sizeof(t_sample));
+}
+
+void pitchshift_tilde_setup(void)
+{
+	pitchshift_class = class_new(gensym("pitchshift~"), (t_newmethod)pitchshift_new, (t_method)pitchshift_free, sizeof(t_pitchshift), 0, 0);
+	class_addmethod(pitchshift_class, (t_method)pitchshift_dsp, gensym("dsp"), A_CANT, 0);
+	CLASS_MAINSIGNALIN(pitchshift_class, t_pitchshift, x_f);
+	class_addmethod(pitchshift_class, (t_method)pitchshift_knob, gensym("knob"), A_FLOAT, 0);
+	class_addmethod(pitchshift_class, (t_method)pitchshift_tune, gensym("tune"), A_FLOAT, 0);
+}
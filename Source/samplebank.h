@@ -0,0 +1,381 @@
+/* ------------------------- samplebank --------------------------------------- */
+/*                                                                              */
+/* The packed sample bank format, written by samplepack and mapped by sampler~, */
+/* and the WAV reader that both of them use.                                    */
+/* Written by Francois W. Nel for the Ukulele patch for Organelle.              */
+/*                                                                              */
+/* This program is free software: you can redistribute it and/or modify        */
+/* it under the terms of the GNU General Public License as published by        */
+/* the Free Software Foundation, either version 3 of the License, or           */
+/* (at your option) any later version.                                          */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,             */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of              */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               */
+/* GNU General Public License for more details.                                */
+/*                                                                              */
+/* You should have received a copy of the GNU General Public License           */
+/* along with this program.  If not, see <https://www.gnu.org/licenses/>.      */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#ifndef SAMPLEBANK_H
+#define SAMPLEBANK_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A bank file is laid out as:
+ *
+ *   t_samplebank_header
+ *   t_samplebank_entry[numentries]  sample names, sorted, each pointing to a body
+ *   t_samplebank_body[numbodies]    where the frames of each distinct sample are
+ *   frames                          every body starts on a kBankAlign boundary
+ *
+ * Samples with the same frames share one body. The frames are mono, in the native byte
+ * order of the machine that wrote the bank, so they can be played straight from the
+ * mapped file; a bank from a machine with the other byte order is refused by its magic.
+ *
+ * FWN: In a kBankBlock bank, the frames are 24-bit integers cut into blocks of
+ * BANK_BLOCK frames, and every block is stored as its first frame followed by the
+ * differences between neighbouring frames, in the fewest bytes (1 to 4) that hold the
+ * largest difference. The body starts with a table of one uint32_t per block: the offset
+ * of the block from the start of the body, which is a multiple of 4, ORed with its byte
+ * width minus 1. This is lossless for 16 and 24-bit files, and a block can be decoded on
+ * its own, so a voice decodes only the block it is playing.
+ */
+
+#define kBankMagic 0x4b4e4253 /* "SBNK" when written little-endian */
+#define kBankVersion 2
+#define kBankAlign 4096 /* a page, so that the bodies are mapped and shared page by page */
+
+#define kBankFloat32 0 /* frames are floats between -1 and 1 */
+#define kBankInt16 1   /* frames are shorts, to be scaled by 1/32768 */
+#define kBankBlock 2   /* frames are 24-bit integers in compressed blocks, see above */
+
+#define BANK_BLOCK 64 /* frames per compressed block */
+
+#define BANK_NAME_SIZE 56
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format; /* kBankFloat32, kBankInt16 or kBankBlock */
+	uint32_t numentries;
+	uint32_t numbodies;
+	uint32_t reserved;
+	uint64_t size; /* of the whole file, to detect truncated banks */
+} t_samplebank_header;
+
+typedef struct
+{
+	char name[BANK_NAME_SIZE]; /* file name without ".wav", NUL terminated */
+	uint32_t body;
+	uint32_t reserved;
+} t_samplebank_entry;
+
+typedef struct
+{
+	uint64_t offset; /* of the first frame, from the start of the file */
+	uint64_t size;	 /* in bytes */
+	uint32_t frames;
+	uint32_t samplerate;
+} t_samplebank_body;
+
+/* Returns the size of a frame, or 0 for kBankBlock, where it varies. */
+static inline size_t samplebank_framesize(uint32_t format)
+{
+	return format == kBankInt16 ? sizeof(int16_t) : format == kBankFloat32 ? sizeof(float) : 0;
+}
+
+/* FWN: Decodes block number <block> of a kBankBlock body into floats between -1 and 1.
+ * The widening and the conversion loops are kept separate from the running sum, which
+ * can't be vectorized, so that the compiler vectorizes them.
+ */
+static inline void samplebank_decodeblock(float *out, const unsigned char *body, uint32_t block, int frames)
+{
+	int32_t value[BANK_BLOCK];
+	const unsigned char *p;
+	uint32_t entry;
+	int i;
+
+	memcpy(&entry, body + 4 * (size_t)block, 4);
+	p = body + (entry & ~3u);
+	memcpy(&value[0], p, 4);
+	p += 4;
+
+	switch (entry & 3)
+	{
+	case 0:
+		for (i = 1; i < frames; i++)
+			value[i] = ((const int8_t *)p)[i - 1];
+		break;
+	case 1:
+		for (i = 1; i < frames; i++)
+			value[i] = ((const int16_t *)p)[i - 1];
+		break;
+	case 2: /* only loud attacks need this, so it need not be fast */
+		for (i = 1; i < frames; i++, p += 3)
+			value[i] = (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8;
+		break;
+	default:
+		for (i = 1; i < frames; i++)
+			value[i] = ((const int32_t *)p)[i - 1];
+		break;
+	}
+	for (i = 1; i < frames; i++)
+		value[i] += value[i - 1];
+	for (i = 0; i < frames; i++)
+		out[i] = value[i] * (1.f / 8388608);
+}
+
+/* ---------------------------- WAV files -------------------------------------- */
+
+#define kFormatPCM 1
+#define kFormatFloat 3
+#define kFormatExtensible 0xfffe
+
+typedef struct
+{
+	const unsigned char *data; /* first frame, interleaved */
+	int frames;
+	int channels;
+	int bits;
+	int isfloat;
+	int samplerate;
+} t_samplebank_wav;
+
+static inline unsigned int samplebank_le16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline unsigned int samplebank_le32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+/* FWN: Finds the format and the frames of a WAV file of <size> bytes, of which the first
+ * <available> bytes have been read into memory. wav->data may point past what has been
+ * read. Returns NULL, or what is wrong with the file.
+ */
+static inline const char *samplebank_parsewavprefix(const unsigned char *file, size_t available, size_t size, t_samplebank_wav *wav)
+{
+	const unsigned char *chunk, *fmt = 0, *data = 0;
+	size_t chunksize, datasize = 0;
+	unsigned int format;
+
+	if (available < 12 || memcmp(file, "RIFF", 4) || memcmp(file + 8, "WAVE", 4))
+		return "not a WAV file";
+
+	/* FWN: Skip the chunks that are not needed, such as bext and junk. Chunks are padded to an even size. */
+	for (chunk = file + 12; chunk + 8 <= file + available; chunk += 8 + chunksize + (chunksize & 1))
+	{
+		chunksize = samplebank_le32(chunk + 4);
+		if (chunksize > size - (size_t)(chunk + 8 - file))
+			chunksize = size - (size_t)(chunk + 8 - file); /* truncated file */
+		if (!memcmp(chunk, "fmt ", 4) && chunksize >= 16 && chunk + 8 + 16 <= file + available)
+			fmt = chunk + 8;
+		else if (!memcmp(chunk, "data", 4))
+		{
+			data = chunk + 8;
+			datasize = chunksize;
+		}
+	}
+	if (!fmt || !data)
+		return "not a WAV file";
+
+	format = samplebank_le16(fmt);
+	wav->channels = (int)samplebank_le16(fmt + 2);
+	wav->samplerate = (int)samplebank_le32(fmt + 4);
+	wav->bits = (int)samplebank_le16(fmt + 14);
+	if (format == kFormatExtensible && samplebank_le32(fmt - 4) >= 26 && fmt + 26 <= file + available)
+		format = samplebank_le16(fmt + 24); /* first two bytes of the subformat GUID */
+	wav->isfloat = (format == kFormatFloat);
+	if (wav->channels < 1 || !((format == kFormatPCM && (wav->bits == 8 || wav->bits == 16 || wav->bits == 24 || wav->bits == 32)) || (wav->isfloat && wav->bits == 32)))
+		return "unsupported format";
+
+	wav->data = data;
+	wav->frames = (int)(datasize / ((size_t)wav->channels * (wav->bits / 8)));
+	return 0;
+}
+
+/* Finds the format and the frames of a WAV file that has been read into memory. */
+static inline const char *samplebank_parsewav(const unsigned char *file, size_t size, t_samplebank_wav *wav)
+{
+	return samplebank_parsewavprefix(file, size, size, wav);
+}
+
+/* FWN: Converts the frames of a WAV file to mono floats between -1 and 1. There is one
+ * loop per sample format, without a test of the format for every sample, so that the
+ * compiler vectorizes them; the channels are added up in <out> one after another.
+ */
+static inline void samplebank_convert(float *out, const t_samplebank_wav *wav)
+{
+	const unsigned char *in;
+	int bytes = wav->bits / 8, stride = wav->channels * bytes, frames = wav->frames, i, c;
+	float scale = 1.f / wav->channels;
+	union
+	{
+		uint32_t i;
+		float f;
+	} u;
+
+	for (i = 0; i < frames; i++)
+		out[i] = 0;
+	for (c = 0; c < wav->channels; c++)
+	{
+		in = wav->data + c * bytes;
+		if (wav->isfloat)
+			for (i = 0; i < frames; i++)
+			{
+				u.i = samplebank_le32(in + (size_t)i * stride);
+				out[i] += u.f;
+			}
+		else if (wav->bits == 8) /* 8-bit samples are unsigned */
+			for (i = 0; i < frames; i++)
+				out[i] += (in[(size_t)i * stride] - 128) * (1.f / 128);
+		else if (wav->bits == 16)
+			for (i = 0; i < frames; i++)
+				out[i] += (int16_t)samplebank_le16(in + (size_t)i * stride) * (1.f / 32768);
+		else if (wav->bits == 24)
+			for (i = 0; i < frames; i++)
+			{
+				const unsigned char *p = in + (size_t)i * stride;
+				out[i] += (int32_t)((p[0] << 8) | (p[1] << 16) | ((uint32_t)p[2] << 24)) * (1.f / 2147483648.f);
+			}
+		else
+			for (i = 0; i < frames; i++)
+				out[i] += (int32_t)samplebank_le32(in + (size_t)i * stride) * (1.f / 2147483648.f);
+	}
+	for (i = 0; i < frames; i++)
+		out[i] *= scale;
+}
+
+/* ---------------------------- sample-rate conversion ------------------------ */
+
+/* FWN: A polyphase windowed-sinc resampler, to convert the samples once when they are
+ * loaded instead of interpolating in every voice. The ratio of the rates is reduced to
+ * <up>/<down>, and output frame n is at input frame n * down / up. Every phase of the
+ * fraction has its own filter of r_taps Kaiser-windowed sinc taps, low-passed below the
+ * lower of the two Nyquist frequencies; for ratios with more than MAX_RESAMPLE_PHASES
+ * phases, the nearest phase is used. Each filter is a plain dot product, which the
+ * compiler vectorizes.
+ */
+
+#define kResampleZeros 32	 /* zero crossings of the sinc on each side */
+#define kResampleBeta 8.6	 /* of the Kaiser window: about 90 dB stopband */
+#define kResampleCutoff 0.94 /* of the lower Nyquist frequency, to leave room for the transition */
+#define MAX_RESAMPLE_PHASES 1024
+
+typedef struct
+{
+	int r_up;
+	int r_down;
+	int r_phases;
+	int r_taps;		 /* per phase, centred on the input frame before the output frame */
+	float *r_filter; /* r_phases * r_taps */
+} t_samplebank_resampler;
+
+static inline double samplebank_bessel0(double x)
+{
+	double sum = 1, term = 1;
+	int k;
+
+	for (k = 1; k < 50 && term > sum * 1e-12; k++)
+	{
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+/* Makes the filters to convert from rate <from> to rate <to>. Returns 0 if it can't. */
+static inline int samplebank_resampler_new(t_samplebank_resampler *r, int from, int to)
+{
+	int a = from, b = to, t, p, k, half;
+	double cutoff, x, w, sum;
+	float *h;
+
+	if (from <= 0 || to <= 0)
+		return 0;
+	while (b)
+	{
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	r->r_up = to / a;
+	r->r_down = from / a;
+	r->r_phases = r->r_up < MAX_RESAMPLE_PHASES ? r->r_up : MAX_RESAMPLE_PHASES;
+	cutoff = kResampleCutoff * (to < from ? (double)to / from : 1);
+	half = (int)ceil(kResampleZeros / cutoff);
+	r->r_taps = 2 * half;
+	if (!(r->r_filter = (float *)malloc((size_t)r->r_phases * r->r_taps * sizeof(float))))
+		return 0;
+
+	for (p = 0; p < r->r_phases; p++)
+	{
+		h = r->r_filter + (size_t)p * r->r_taps;
+		for (k = 0, sum = 0; k < r->r_taps; k++)
+		{
+			x = k - half + 1 - (double)p / r->r_phases; /* from the output frame, in input frames */
+			w = fabs(x) < half ? samplebank_bessel0(kResampleBeta * sqrt(1 - (x / half) * (x / half))) / samplebank_bessel0(kResampleBeta) : 0;
+			h[k] = (float)(w * (x == 0 ? cutoff : sin(M_PI * cutoff * x) / (M_PI * x)));
+			sum += h[k];
+		}
+		for (k = 0; k < r->r_taps; k++) /* unity gain at DC for every phase */
+			h[k] = (float)(h[k] / sum);
+	}
+	return 1;
+}
+
+static inline void samplebank_resampler_free(t_samplebank_resampler *r)
+{
+	free(r->r_filter);
+	r->r_filter = 0;
+}
+
+/* The number of frames that <frames> input frames are converted to. */
+static inline int samplebank_resampledlength(const t_samplebank_resampler *r, int frames)
+{
+	return (int)(((int64_t)frames * r->r_up + r->r_down - 1) / r->r_down);
+}
+
+/* Converts <frames> frames from <in> into samplebank_resampledlength frames in <out>. */
+static inline void samplebank_resample(const t_samplebank_resampler *r, float *out, const float *in, int frames)
+{
+	int length = samplebank_resampledlength(r, frames), half = r->r_taps / 2, n, k, phase;
+	int64_t position, frame;
+	const float *h;
+	float sum;
+
+	for (n = 0; n < length; n++)
+	{
+		position = (int64_t)n * r->r_down;
+		frame = position / r->r_up;
+		phase = (int)(r->r_phases == r->r_up ? position % r->r_up : ((position % r->r_up) * r->r_phases + r->r_up / 2) / r->r_up);
+		if (phase == r->r_phases)
+		{
+			frame++;
+			phase = 0;
+		}
+		h = r->r_filter + (size_t)phase * r->r_taps;
+		frame -= half - 1;
+		sum = 0;
+		if (frame >= 0 && frame + r->r_taps <= frames)
+			for (k = 0; k < r->r_taps; k++)
+				sum += h[k] * in[frame + k];
+		else /* the frames before the start and after the end are 0 */
+			for (k = 0; k < r->r_taps; k++)
+				if (frame + k >= 0 && frame + k < frames)
+					sum += h[k] * in[frame + k];
+		out[n] = sum;
+	}
+}
+
+#endif
@@ -0,0 +1,401 @@
+/* ------------------------- samplepack --------------------------------------- */
+/*                                                                              */
+/* Packs a directory of WAV files into one bank file for sampler~.              */
+/* Written by Francois W. Nel for the Ukulele patch for Organelle.              */
+/*                                                                              */
+/* This program is free software: you can redistribute it and/or modify        */
+/* it under the terms of the GNU General Public License as published by        */
+/* the Free Software Foundation, either version 3 of the License, or           */
+/* (at your option) any later version.                                          */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,             */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of              */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               */
+/* GNU General Public License for more details.                                */
+/*                                                                              */
+/* You should have received a copy of the GNU General Public License           */
+/* along with this program.  If not, see <https://www.gnu.org/licenses/>.      */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "samplebank.h"
+
+/* Version: samplepack v0.1
+ * Usage: samplepack [-f float32|int16|block] [-r rate] <directory> <bank>
+ *
+ * Every "<name>.wav" file in the directory is decoded to mono and stored under <name>,
+ * in the format described in samplebank.h: floats, shorts, or compressed blocks of 24-bit
+ * integers. Files with the same frames, such as the
+ * muted strings of the Ukulele, are stored once. The bank is written next to its final
+ * name and renamed when it is complete, so a sampler~ that has the old bank mapped keeps
+ * playing from it. Built and run by "make bank".
+ *
+ * FWN: With -r, the samples are converted to <rate> first, so that a sampler~ running at
+ * that rate maps the bank instead of converting the WAV files every time it loads them.
+ */
+
+typedef struct
+{
+	char name[BANK_NAME_SIZE];
+	int body;
+} t_samplepack_entry;
+
+typedef struct
+{
+	float *frames;
+	uint32_t numframes;
+	uint32_t samplerate;
+	uint64_t hash;
+	int refs; /* number of samples that use the body */
+	unsigned char *data; /* the frames in the format of the bank */
+	uint64_t size;
+	uint64_t offset;
+} t_samplepack_body;
+
+static int samplepack_compare(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* FNV-1a, to find candidates for de-duplication quickly. */
+static uint64_t samplepack_hash(const float *frames, uint32_t numframes)
+{
+	const unsigned char *p = (const unsigned char *)frames;
+	uint64_t hash = 14695981039346656037ull;
+	size_t i;
+
+	for (i = 0; i < numframes * sizeof(float); i++)
+		hash = (hash ^ p[i]) * 1099511628211ull;
+	return hash;
+}
+
+static unsigned char *samplepack_readfile(const char *path, size_t *size)
+{
+	unsigned char *file;
+	FILE *fd;
+	long n;
+
+	if (!(fd = fopen(path, "rb")))
+		return 0;
+	fseek(fd, 0, SEEK_END);
+	n = ftell(fd);
+	fseek(fd, 0, SEEK_SET);
+	if (n <= 0 || !(file = (unsigned char *)malloc(n)) || fread(file, 1, n, fd) != (size_t)n)
+	{
+		fclose(fd);
+		return 0;
+	}
+	fclose(fd);
+	*size = (size_t)n;
+	return file;
+}
+
+/* FWN: Compresses 24-bit frames into blocks, see samplebank.h. Returns the size. */
+static uint64_t samplepack_encodeblocks(unsigned char *out, const float *frames, uint32_t numframes)
+{
+	uint32_t numblocks = (numframes + BANK_BLOCK - 1) / BANK_BLOCK, block, entry;
+	uint64_t size = (uint64_t)numblocks * 4;
+	int32_t value[BANK_BLOCK], diff;
+	int i, n, width, maxdiff;
+	float v;
+
+	for (block = 0; block < numblocks; block++)
+	{
+		n = numframes - block * BANK_BLOCK < BANK_BLOCK ? (int)(numframes - block * BANK_BLOCK) : BANK_BLOCK;
+		for (i = 0, maxdiff = 0; i < n; i++)
+		{
+			v = roundf(frames[block * BANK_BLOCK + i] * 8388608);
+			value[i] = (int32_t)(v > 8388607 ? 8388607 : v < -8388608 ? -8388608 : v);
+			diff = i ? value[i] - value[i - 1] : 0;
+			if (diff > maxdiff || -diff > maxdiff)
+				maxdiff = diff > 0 ? diff : -diff;
+		}
+		width = maxdiff < 128 ? 1 : maxdiff < 32768 ? 2 : maxdiff < 8388608 ? 3 : 4; /* in bytes */
+
+		entry = (uint32_t)size | (uint32_t)(width - 1);
+		memcpy(out + 4 * block, &entry, 4);
+		memcpy(out + size, &value[0], 4);
+		size += 4;
+		for (i = 1; i < n; i++)
+		{
+			diff = value[i] - value[i - 1];
+			if (width == 1)
+				((int8_t *)(out + size))[i - 1] = (int8_t)diff;
+			else if (width == 2)
+				((int16_t *)(out + size))[i - 1] = (int16_t)diff;
+			else if (width == 3) /* little-endian, like the frames of a WAV file */
+			{
+				out[size + 3 * (i - 1)] = (unsigned char)diff;
+				out[size + 3 * (i - 1) + 1] = (unsigned char)(diff >> 8);
+				out[size + 3 * (i - 1) + 2] = (unsigned char)(diff >> 16);
+			}
+			else
+				((int32_t *)(out + size))[i - 1] = diff;
+		}
+		size += (uint64_t)(n - 1) * width;
+		size = (size + 3) & ~(uint64_t)3; /* the next block starts on 4 bytes */
+	}
+	return size;
+}
+
+/* Converts the frames of a body to the format of the bank. */
+static void samplepack_encode(t_samplepack_body *body, uint32_t format)
+{
+	uint32_t numframes = body->numframes, f;
+	int16_t *shorts;
+	float v;
+
+	if (format == kBankInt16)
+	{
+		body->size = numframes * sizeof(int16_t);
+		body->data = (unsigned char *)malloc(body->size ? body->size : 1);
+		shorts = (int16_t *)body->data;
+		for (f = 0; f < numframes; f++)
+		{
+			v = roundf(body->frames[f] * 32768);
+			shorts[f] = (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+		}
+	}
+	else if (format == kBankBlock)
+	{
+		/* at worst 4 bytes per frame, and the table and the first frame of every block */
+		body->data = (unsigned char *)calloc((size_t)numframes * 4 + ((numframes + BANK_BLOCK - 1) / BANK_BLOCK) * 8 + 1, 1);
+		body->size = samplepack_encodeblocks(body->data, body->frames, numframes);
+	}
+	else
+	{
+		body->size = numframes * sizeof(float);
+		body->data = (unsigned char *)malloc(body->size ? body->size : 1);
+		memcpy(body->data, body->frames, body->size);
+	}
+}
+
+static int samplepack_write(FILE *fd, const void *data, size_t size)
+{
+	return fwrite(data, 1, size, fd) == size;
+}
+
+static int samplepack_pad(FILE *fd, uint64_t *position)
+{
+	static const char zeros[kBankAlign];
+	size_t n = (size_t)((kBankAlign - *position % kBankAlign) % kBankAlign);
+
+	*position += n;
+	return samplepack_write(fd, zeros, n);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir, *bankpath, *error;
+	char path[4096], tmppath[4096];
+	char **names = 0;
+	int numnames = 0, allocated = 0, numbodies = 0, rate = 0, i, j, len;
+	uint32_t format = kBankFloat32;
+	t_samplebank_resampler resampler;
+	float *frames;
+	t_samplepack_entry *entries;
+	t_samplepack_body *bodies;
+	t_samplebank_header header;
+	t_samplebank_entry entry;
+	t_samplebank_body body;
+	t_samplebank_wav wav;
+	uint64_t position, saved = 0;
+	unsigned char *file;
+	struct dirent *de;
+	size_t size;
+	DIR *dp;
+	FILE *fd;
+
+	while (argc > 4 && argv[1][0] == '-')
+	{
+		if (!strcmp(argv[1], "-f") && !strcmp(argv[2], "int16"))
+			format = kBankInt16;
+		else if (!strcmp(argv[1], "-f") && !strcmp(argv[2], "block"))
+			format = kBankBlock;
+		else if (!strcmp(argv[1], "-r") && (rate = atoi(argv[2])) > 0)
+			;
+		else if (strcmp(argv[1], "-f") || strcmp(argv[2], "float32"))
+			argc = 0;
+		argc -= 2, argv += 2;
+	}
+	if (argc != 3)
+	{
+		fprintf(stderr, "usage: samplepack [-f float32|int16|block] [-r rate] <directory> <bank>\n");
+		return 2;
+	}
+	dir = argv[1];
+	bankpath = argv[2];
+
+	if (!(dp = opendir(dir)))
+	{
+		fprintf(stderr, "samplepack: %s: can't open directory\n", dir);
+		return 1;
+	}
+	while ((de = readdir(dp)))
+	{
+		len = (int)strlen(de->d_name);
+		if (len <= 4 || strcmp(de->d_name + len - 4, ".wav"))
+			continue;
+		if (len - 4 >= BANK_NAME_SIZE)
+		{
+			fprintf(stderr, "samplepack: %s: name is too long, skipped\n", de->d_name);
+			continue;
+		}
+		if (numnames == allocated)
+		{
+			allocated = allocated ? 2 * allocated : 128;
+			names = (char **)realloc(names, allocated * sizeof(char *));
+		}
+		names[numnames++] = strdup(de->d_name);
+	}
+	closedir(dp);
+	qsort(names, numnames, sizeof(char *), samplepack_compare); /* the same bank for the same files */
+
+	entries = (t_samplepack_entry *)calloc(numnames ? numnames : 1, sizeof(t_samplepack_entry));
+	bodies = (t_samplepack_body *)calloc(numnames ? numnames : 1, sizeof(t_samplepack_body));
+	for (i = 0; i < numnames; i++)
+	{
+		snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+		if (!(file = samplepack_readfile(path, &size)))
+		{
+			fprintf(stderr, "samplepack: %s: can't read\n", path);
+			return 1;
+		}
+		if ((error = samplebank_parsewav(file, size, &wav)))
+		{
+			fprintf(stderr, "samplepack: %s: %s\n", path, error);
+			return 1;
+		}
+		bodies[numbodies].frames = (float *)malloc((wav.frames ? wav.frames : 1) * sizeof(float));
+		bodies[numbodies].numframes = (uint32_t)wav.frames;
+		bodies[numbodies].samplerate = (uint32_t)wav.samplerate;
+		samplebank_convert(bodies[numbodies].frames, &wav);
+		if (rate && wav.samplerate != rate)
+		{
+			if (!samplebank_resampler_new(&resampler, wav.samplerate, rate))
+			{
+				fprintf(stderr, "samplepack: %s: can't convert from %d Hz\n", path, wav.samplerate);
+				return 1;
+			}
+			bodies[numbodies].numframes = (uint32_t)samplebank_resampledlength(&resampler, wav.frames);
+			bodies[numbodies].samplerate = (uint32_t)rate;
+			frames = (float *)malloc((bodies[numbodies].numframes ? bodies[numbodies].numframes : 1) * sizeof(float));
+			samplebank_resample(&resampler, frames, bodies[numbodies].frames, wav.frames);
+			samplebank_resampler_free(&resampler);
+			free(bodies[numbodies].frames);
+			bodies[numbodies].frames = frames;
+		}
+		bodies[numbodies].hash = samplepack_hash(bodies[numbodies].frames, bodies[numbodies].numframes);
+		free(file);
+
+		snprintf(entries[i].name, BANK_NAME_SIZE, "%.*s", (int)strlen(names[i]) - 4, names[i]);
+		entries[i].body = numbodies;
+
+		// FWN: Share the body of an earlier sample with the same frames.
+		for (j = 0; j < numbodies; j++)
+			if (bodies[j].hash == bodies[numbodies].hash && bodies[j].numframes == bodies[numbodies].numframes &&
+				bodies[j].samplerate == bodies[numbodies].samplerate &&
+				!memcmp(bodies[j].frames, bodies[numbodies].frames, bodies[j].numframes * sizeof(float)))
+				break;
+		if (j < numbodies)
+		{
+			entries[i].body = j;
+			free(bodies[numbodies].frames);
+		}
+		else
+			numbodies++;
+		bodies[entries[i].body].refs++;
+	}
+
+	/* lay out the frames after the index */
+	position = sizeof(t_samplebank_header) + (uint64_t)numnames * sizeof(t_samplebank_entry) + (uint64_t)numbodies * sizeof(t_samplebank_body);
+	for (j = 0; j < numbodies; j++)
+	{
+		samplepack_encode(&bodies[j], format);
+		position = (position + kBankAlign - 1) / kBankAlign * kBankAlign;
+		bodies[j].offset = position;
+		position += bodies[j].size;
+		saved += (bodies[j].refs - 1) * ((bodies[j].size + kBankAlign - 1) / kBankAlign * kBankAlign);
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = kBankMagic;
+	header.version = kBankVersion;
+	header.format = format;
+	header.numentries = (uint32_t)numnames;
+	header.numbodies = (uint32_t)numbodies;
+	header.size = position;
+
+	snprintf(tmppath, sizeof(tmppath), "%s.tmp", bankpath);
+	if (!(fd = fopen(tmppath, "wb")))
+	{
+		fprintf(stderr, "samplepack: %s: can't create\n", tmppath);
+		return 1;
+	}
+	position = 0;
+	if (!samplepack_write(fd, &header, sizeof(header)))
+		goto bad;
+	position += sizeof(header);
+	for (i = 0; i < numnames; i++)
+	{
+		memset(&entry, 0, sizeof(entry));
+		memcpy(entry.name, entries[i].name, BANK_NAME_SIZE);
+		entry.body = (uint32_t)entries[i].body;
+		if (!samplepack_write(fd, &entry, sizeof(entry)))
+			goto bad;
+		position += sizeof(entry);
+	}
+	for (j = 0; j < numbodies; j++)
+	{
+		body.offset = bodies[j].offset;
+		body.size = bodies[j].size;
+		body.frames = bodies[j].numframes;
+		body.samplerate = bodies[j].samplerate;
+		if (!samplepack_write(fd, &body, sizeof(body)))
+			goto bad;
+		position += sizeof(body);
+	}
+	for (j = 0; j < numbodies; j++)
+	{
+		if (!samplepack_pad(fd, &position) || !samplepack_write(fd, bodies[j].data, bodies[j].size))
+			goto bad;
+		position += bodies[j].size;
+	}
+	if (fclose(fd))
+	{
+		fd = 0;
+		goto bad;
+	}
+	if (rename(tmppath, bankpath))
+	{
+		fprintf(stderr, "samplepack: %s: can't replace\n", bankpath);
+		remove(tmppath);
+		return 1;
+	}
+
+	printf("samplepack: %d samples, %d distinct, %.1f MB (%.0f kB saved by sharing)\n", numnames, numbodies,
+		   header.size / 1048576.0, saved / 1024.0);
+	for (j = 0; j < numbodies; j++)
+	{
+		free(bodies[j].frames);
+		free(bodies[j].data);
+	}
+	for (i = 0; i < numnames; i++)
+		free(names[i]);
+	free(names);
+	free(entries);
+	free(bodies);
+	return 0;
+
+bad:
+	fprintf(stderr, "samplepack: %s: can't write\n", tmppath);
+	if (fd)
+		fclose(fd);
+	remove(tmppath);
+	return 1;
+}
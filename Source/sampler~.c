@@ -0,0 +1,1717 @@
+/* ------------------------- sampler~ ----------------------------------------- */
+/*                                                                              */
+/* Plays samples that were loaded into memory when the patch was opened.        */
+/* Written by Francois W. Nel for the Ukulele patch for Organelle.              */
+/*                                                                              */
+/* This program is free software: you can redistribute it and/or modify        */
+/* it under the terms of the GNU General Public License as published by        */
+/* the Free Software Foundation, either version 3 of the License, or           */
+/* (at your option) any later version.                                          */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,             */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of              */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               */
+/* GNU General Public License for more details.                                */
+/*                                                                              */
+/* You should have received a copy of the GNU General Public License           */
+/* along with this program.  If not, see <https://www.gnu.org/licenses/>.      */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#include "m_pd.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#include "pdfiles.h"
+#include "samplebank.h"
+
+/* Version: sampler~ v0.1
+ * Every "<name>.wav" file in the directory is decoded into memory once, when the first
+ * sampler~ for that directory is created. All sampler~ objects for the same directory
+ * share the samples, so the strings and percussion of the patch load them only once.
+ * "play <name>" starts a voice at the beginning of the next DSP block, without opening a
+ * file or waiting for the disk like readsf~ does.
+ *
+ * FWN: The files are decoded by one thread per core, up to MAX_DECODERS, so that a
+ * quad-core Organelle M loads the samples about four times as fast. The time that every
+ * file took is posted at log level 4, and the total at level 3.
+ *
+ * Usage: [sampler~ <directory> <voices>], with the directory relative to the patch and
+ * the number of voices of this object that can play at once (default 1). "stop" fades out
+ * all voices of the object.
+ *
+ * FWN: "set <name>" chooses the sample without playing it. Every sample of the signal in
+ * the left inlet that is not 0 then starts that sample at exactly that sample of the
+ * block, which is how strum~ plucks the strings with sample-accurate timing.
+ *
+ * FWN: The voices come from a pool that all sampler~ objects share, so that the number of
+ * voices, and with it the CPU time, is bounded for the whole patch. "pool <voices>" sets
+ * how many voices may play at once (default DEFAULT_POOL). When an object or the pool has
+ * no voice left, "play" steals one: the quietest (default) or the oldest, as set with
+ * "steal quietest|oldest". A stolen or stopped voice fades out over kFadeTime ms while
+ * the new note starts at once, so notes overlap briefly instead of being cut with a click.
+ *
+ * FWN: A voice ends when it has been kSilence below its peak so far for kQuietTime ms, so
+ * the tail of a sample that has died away costs nothing, and neither does a sampler~
+ * without voices. The threshold follows the peak, so a quiet lead-in or a pause at the
+ * noise floor of a recording doesn't end the voice, and a voice that has been silent
+ * since it started plays on until the sample ends.
+ *
+ * PCM files with 8, 16, 24 or 32-bit integers or 32-bit floats are read, in any sample
+ * rate and with any number of channels; channels are mixed down to mono.
+ *
+ * FWN: Samples at another rate than Pd are converted when they are loaded, with the
+ * polyphase windowed-sinc resampler of samplebank.h, so that a voice still only copies
+ * frames. A packed bank at another rate is not used then, and a bank is loaded again
+ * for each sample rate; "make bank BANKRATE=<rate>" packs a bank that is converted
+ * already. The tails of streamed samples can't be converted.
+ *
+ * FWN: If there is a packed bank "<directory>.bank" next to the directory, made by
+ * samplepack ("make bank"), it is mapped into memory instead of reading the WAV files.
+ * The patch is then playable as soon as the bank's index has been read, and the frames
+ * are paged in from the file in the background and shared between processes.
+ *
+ * FWN: For banks too large to keep in memory, [sampler~ <directory> <voices> <budget>]
+ * streams the WAV files instead, keeping at most <budget> MB in memory. Only the first
+ * kHeadTime ms of every sample (the head) are read when the bank is loaded, so a note
+ * starts as soon as it is played. While the head plays, a background thread reads the
+ * rest (the tail) from the file into a ring buffer of the voice, and the voice plays on
+ * from the ring. The tails of the samples that are played are kept in a cache while they
+ * fit in what the heads and the MAX_RINGS ring buffers leave of the budget, and then
+ * played from memory; when the cache is full, the tails of the samples that were played
+ * least recently are evicted. A bank is streamed if the first sampler~ of its directory
+ * has a budget, and a packed bank is not used then. Streaming is not available on Windows.
+ *
+ * FWN: "open <directory> [budget]" switches to another bank without stopping the sound.
+ * The bank is loaded in a thread, and nothing that posts or creates symbols runs there:
+ * messages and sample names are kept until the bank has been loaded, and then posted and
+ * named in Pd's thread, which checks every kLoadPoll ms. The notes that are playing finish
+ * from the old bank and the next ones come from the new bank; the old bank is freed once
+ * its last voice has ended. The DSP routine allocates nothing for this.
+ */
+
+#define DEFAULT_VOICES 1
+#define DEFAULT_POOL 16
+#define MAX_VOICES 64 /* voices in the pool, playing or fading out */
+
+#define kFadeTime 5.f /* ms to fade out a stolen or stopped voice */
+#define kSilence 1e-4f	 /* -80 dB below the peak of a voice, where it is quiet */
+#define kQuietTime 200.f /* ms that a voice is quiet before it ends */
+
+#define kStealQuietest 0
+#define kStealOldest 1
+
+#define kSamplerStream 3 /* b_format of a streamed bank, after the formats of bank files */
+
+#define kHeadTime 250.f		 /* ms at the start of every streamed sample that stay in memory */
+#define kHeaderSize 65536	 /* bytes read to find the frames of a WAV file */
+#define kStreamPoll 2		 /* ms between the rounds of the streaming thread */
+#define MAX_RINGS 32		 /* voices that can stream at once */
+#define RING_SIZE 16384		 /* frames in a ring buffer, a power of two: 372 ms at 44.1 kHz */
+#define STREAM_CHUNK 65536	 /* bytes read from a file at once */
+
+#define kLoadPoll 20 /* ms between the checks whether "open" has loaded its bank */
+#define MAX_DECODERS 8 /* threads that decode WAV files at once */
+
+#define kRingIdle 0		/* free, and only used by the audio thread */
+#define kRingActive 1	/* filled by the streaming thread and read by a voice */
+#define kRingReleased 2 /* no longer read, to be closed by the streaming thread */
+
+struct sampler_bank;
+
+/* FWN: The tail of a streamed sample. s_tail, s_users and s_lastused are shared between
+ * the audio thread and the streaming thread.
+ */
+typedef struct
+{
+	struct sampler_bank *s_bank;
+	char *s_path;
+	long s_offset;			/* of the first frame of the tail in the file */
+	t_samplebank_wav s_wav; /* format of the frames in the file */
+	int s_headlength;		/* frames in the head, which is the data of the sample */
+	_Atomic(float *) s_tail; /* the frames of the tail if they are in the cache, or NULL */
+	atomic_int s_users;		 /* voices playing s_tail, which can't be evicted while they do */
+	atomic_uint s_lastused;	 /* p_count when the sample was last started */
+	int s_caching;			 /* whether a ring is reading the tail into the cache, only used by the streaming thread */
+} t_sampler_stream;
+
+typedef struct
+{
+	t_symbol *name;	  /* file name without ".wav", NULL if the slot is empty */
+	const void *data; /* floats, or shorts for an int16 bank */
+	int length;		  /* in samples */
+	t_sampler_stream *stream; /* NULL if all the frames are in data */
+} t_sampler_sample;
+
+/* FWN: The samples of one directory, shared by every sampler~ that plays from it. */
+typedef struct sampler_bank
+{
+	t_symbol *b_dir;			/* full path of the directory */
+	int b_refcount;				/* number of sampler~ objects using the bank */
+	t_sampler_sample *b_table;	/* open addressing hash table keyed by sample name */
+	int b_tablesize;			/* number of slots, a power of two */
+	int b_numsamples;
+	int b_format;				/* kBankFloat32, kBankInt16, kBankBlock or kSamplerStream */
+	int b_samplerate;			/* of Pd when the bank was loaded, which the samples were converted to */
+	void *b_map;				/* mapped bank file, or NULL if the samples were decoded from WAV files */
+	size_t b_mapsize;
+	size_t b_budget; /* bytes that the cached tails of a streamed bank may take */
+	size_t b_cached; /* bytes that they take, only used by the streaming thread */
+	int b_streamed;	 /* whether the streaming thread was started for the bank */
+	int b_voices;	 /* voices playing from the bank, which keep it after its last sampler~ has let it go */
+	struct sampler_bank *b_next;
+} t_sampler_bank;
+
+static t_sampler_bank *sampler_banks;
+static t_sampler_bank *sampler_retired; /* banks that no sampler~ uses, freed when their last voice ends */
+static t_clock *sampler_reaper;			/* frees them outside of the DSP routine */
+
+/* FWN: A bank that is being loaded. Loading creates no symbols and posts nothing, so that
+ * "open" can load a bank in a thread while the current one goes on playing. The names of
+ * the samples and the messages are kept here until sampler_load_finish, in Pd's thread.
+ */
+typedef struct
+{
+	char *n_name;
+	t_sampler_sample n_sample;
+} t_sampler_named;
+
+typedef struct
+{
+	t_sampler_bank *l_bank;
+	t_float l_budget; /* MB, or 0 to load all the frames */
+	int l_samplerate; /* to convert the samples to */
+	atomic_int l_unconverted; /* streamed samples at another rate, which can't be converted */
+	t_sampler_named *l_samples;
+	int l_numsamples;
+	int l_maxsamples;
+	char *l_log; /* messages, one per line, starting with the digit of their level */
+	size_t l_logsize;
+	int l_ok;		   /* whether the bank could be loaded */
+	atomic_int l_done; /* set when loading has finished */
+} t_sampler_load;
+
+/* FWN: A ring buffer that the streaming thread fills with the tail of a sample, for a
+ * voice to play. r_read and r_write count the frames of the tail, so a voice that has
+ * run out of frames can go on, and the thread skips the frames it missed. r_sample is
+ * only set while the ring is idle.
+ */
+typedef struct
+{
+	atomic_int r_state; /* kRingIdle, kRingActive or kRingReleased */
+	t_sampler_sample *r_sample;
+	atomic_int r_read;	/* next frame of the tail that the voice plays */
+	atomic_int r_write; /* frames of the tail that are in the ring */
+	int r_fd;			/* the file, only used by the streaming thread */
+	int r_cached;		/* whether the thread has tried to cache the tail */
+	float *r_tail;		/* the tail while it is read into the cache, a chunk a round */
+	int r_tailframes;	/* frames of it that have been read */
+	float r_frames[RING_SIZE];
+} t_sampler_ring;
+
+static t_sampler_ring *sampler_rings; /* MAX_RINGS rings while a bank is streamed */
+
+typedef struct sampler
+{
+	t_object x_ob;
+
+	t_float x_f; /* for signals coming into the left inlet */
+
+	t_sampler_bank *x_bank;
+	int x_numvoices;		   /* voices of this object that may play at once */
+	t_sampler_sample *x_next; /* sample that the signal starts, set with "set" */
+
+	t_canvas *x_canvas;		/* to find directories relative to the patch */
+	t_sampler_load *x_load; /* bank that "open" is loading, or NULL */
+	t_clock *x_clock;		/* checks whether it has been loaded */
+#ifndef _WIN32
+	pthread_t x_loader;
+#endif
+} t_sampler;
+
+/* FWN: The voices shared by all sampler~ objects. The state of the voices is kept as a
+ * structure of arrays, so that the pool can be searched without touching the decoded
+ * blocks, and the loops over one field are short and contiguous.
+ */
+typedef struct
+{
+	int p_limit;		   /* voices that may play at once, not counting those fading out */
+	int p_steal;		   /* kStealQuietest or kStealOldest */
+	int p_fadelength;	   /* samples to fade out over */
+	int p_quietlength;	   /* samples that a voice is quiet before it ends */
+	unsigned int p_count;  /* notes started so far, to tell the age of the voices */
+	t_sampler *p_owner[MAX_VOICES];			/* object that plays the voice, NULL if it is free */
+	t_sampler_bank *p_bank[MAX_VOICES];		/* bank of the sample, which may no longer be the bank of the owner */
+	t_sampler_sample *p_sample[MAX_VOICES];
+	int p_format[MAX_VOICES];				/* of the bank of the sample */
+	int p_position[MAX_VOICES];				/* next frame to play */
+	int p_length[MAX_VOICES];				/* frames to play, less than the sample if it can't be streamed */
+	const float *p_tail[MAX_VOICES];		/* cached tail of a streamed sample */
+	t_sampler_ring *p_ring[MAX_VOICES];		/* ring of a streamed sample that is not cached */
+	int p_delay[MAX_VOICES];				/* samples of the current block before the voice starts */
+	unsigned int p_start[MAX_VOICES];		/* p_count when the voice started */
+	float p_gain[MAX_VOICES];
+	float p_step[MAX_VOICES];				/* change of the gain per sample while fading out */
+	int p_fade[MAX_VOICES];					/* samples left to fade out, 0 if the voice is not fading */
+	float p_level[MAX_VOICES];				/* peak of the last block that was played */
+	float p_peak[MAX_VOICES];				/* peak of all the blocks that were played */
+	int p_quiet[MAX_VOICES];				/* samples that the voice has been quiet for */
+	int p_block[MAX_VOICES];				/* block of a kBankBlock sample that is in p_frames, or -1 */
+	float p_frames[MAX_VOICES][BANK_BLOCK]; /* the decoded block, or int16 frames converted to floats */
+} t_sampler_pool;
+
+static t_sampler_pool sampler_pool;
+
+static t_sampler_sample *sampler_find(t_sampler_bank *b, t_symbol *s)
+{
+	unsigned int mask = (unsigned int)b->b_tablesize - 1;
+	unsigned int i;
+
+	if (!b->b_tablesize)
+		return 0;
+	for (i = pdfiles_hash(s) & mask; b->b_table[i].name; i = (i + 1) & mask)
+		if (b->b_table[i].name == s)
+			return &b->b_table[i];
+	return 0;
+}
+
+#ifndef _WIN32
+static pthread_mutex_t sampler_loglock = PTHREAD_MUTEX_INITIALIZER; /* for the threads that decode WAV files */
+#endif
+
+/* Keeps a message of logpost <level>, or an error for level 1, until the bank has been loaded. */
+static void sampler_log(t_sampler_load *l, int level, const char *fmt, ...)
+{
+	char line[MAXPDSTRING];
+	size_t length;
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(line + 1, sizeof(line) - 1, fmt, ap);
+	va_end(ap);
+	line[0] = (char)('0' + level);
+	length = strlen(line);
+#ifndef _WIN32
+	pthread_mutex_lock(&sampler_loglock);
+#endif
+	l->l_log = (char *)resizebytes(l->l_log, l->l_logsize, l->l_logsize + length + 1);
+	memcpy(l->l_log + l->l_logsize, line, length);
+	l->l_log[l->l_logsize + length] = '\n';
+	l->l_logsize += length + 1;
+#ifndef _WIN32
+	pthread_mutex_unlock(&sampler_loglock);
+#endif
+}
+
+/* Keeps a sample that has been loaded, with the first <length> characters of <name> as its name. */
+static void sampler_loaded(t_sampler_load *l, const char *name, int length, const t_sampler_sample *sample)
+{
+	t_sampler_named *n;
+
+	if (l->l_numsamples == l->l_maxsamples)
+	{
+		l->l_samples = (t_sampler_named *)resizebytes(l->l_samples, l->l_maxsamples * sizeof(t_sampler_named), (l->l_maxsamples * 2 + 64) * sizeof(t_sampler_named));
+		l->l_maxsamples = l->l_maxsamples * 2 + 64;
+	}
+	n = &l->l_samples[l->l_numsamples++];
+	n->n_name = (char *)getbytes(length + 1);
+	memcpy(n->n_name, name, length);
+	n->n_sample = *sample;
+}
+
+/* FWN: Converts the <*length> frames of a sample at rate <from> to the rate of Pd,
+ * replacing <*data>, so that voices play it without interpolating.
+ */
+static void sampler_resample(t_sampler_load *l, const char *path, int from, float **data, int *length)
+{
+	t_samplebank_resampler r;
+	float *out;
+	int n;
+
+	if (!samplebank_resampler_new(&r, from, l->l_samplerate))
+	{
+		sampler_log(l, 1, "sampler~: %s: can't convert from %d Hz, it plays at the wrong pitch", path, from);
+		return;
+	}
+	n = samplebank_resampledlength(&r, *length);
+	out = (float *)getbytes((n ? n : 1) * sizeof(float));
+	samplebank_resample(&r, out, *data, *length);
+	samplebank_resampler_free(&r);
+	freebytes(*data, (*length ? *length : 1) * sizeof(float));
+	*data = out;
+	*length = n;
+}
+
+/* Decodes a WAV file into memory. Returns 0 and logs why if the file can't be read. */
+static int sampler_readwav(t_sampler_load *l, const char *path, t_sampler_sample *sample)
+{
+	unsigned char *file = 0;
+	t_samplebank_wav wav;
+	const char *error;
+	float *data;
+	long filesize;
+	FILE *fd;
+
+	if (!(fd = fopen(path, "rb")))
+	{
+		sampler_log(l, 1, "sampler~: %s: can't open", path);
+		return 0;
+	}
+	fseek(fd, 0, SEEK_END);
+	filesize = ftell(fd);
+	fseek(fd, 0, SEEK_SET);
+	if (filesize <= 0 || !(file = (unsigned char *)getbytes(filesize)) || fread(file, 1, filesize, fd) != (size_t)filesize)
+		error = "can't read";
+	else if (!(error = samplebank_parsewav(file, filesize, &wav)))
+	{
+		data = (float *)getbytes((wav.frames ? wav.frames : 1) * sizeof(float));
+		samplebank_convert(data, &wav);
+		if (wav.samplerate != l->l_samplerate)
+			sampler_resample(l, path, wav.samplerate, &data, &wav.frames);
+		sample->data = data;
+		sample->length = wav.frames;
+		sample->stream = 0;
+	}
+	if (error)
+		sampler_log(l, 1, "sampler~: %s: %s", path, error);
+
+	if (file)
+		freebytes(file, filesize);
+	fclose(fd);
+	return !error;
+}
+
+/* FWN: Reads the head of a WAV file into memory, and where the tail is for streaming it.
+ * Samples that are less than two heads long are read whole. Returns 0 and logs why if
+ * the file can't be read.
+ */
+static int sampler_readhead(t_sampler_load *l, const char *path, t_sampler_sample *sample)
+{
+	unsigned char *file = 0;
+	size_t available = 0, needed;
+	t_samplebank_wav wav;
+	t_sampler_stream *stream;
+	const char *error;
+	long filesize, offset;
+	int frames, head, framebytes;
+	float *data;
+	FILE *fd;
+
+	if (!(fd = fopen(path, "rb")))
+	{
+		sampler_log(l, 1, "sampler~: %s: can't open", path);
+		return 0;
+	}
+	fseek(fd, 0, SEEK_END);
+	filesize = ftell(fd);
+	fseek(fd, 0, SEEK_SET);
+	if (filesize > 0)
+		available = filesize < kHeaderSize ? (size_t)filesize : kHeaderSize;
+	if (!available || !(file = (unsigned char *)getbytes(available)) || fread(file, 1, available, fd) != available)
+		error = "can't read";
+	else if (!(error = samplebank_parsewavprefix(file, available, filesize, &wav)))
+	{
+		offset = (long)(wav.data - file);
+		framebytes = wav.channels * (wav.bits / 8);
+		if (wav.samplerate != l->l_samplerate)
+			atomic_fetch_add(&l->l_unconverted, 1);
+		frames = wav.frames;
+		head = (int)(wav.samplerate * kHeadTime * 0.001f);
+		if (2 * head >= frames)
+			head = frames;
+		needed = offset + (size_t)head * framebytes;
+		if (needed > available)
+		{
+			/* frames that are missing from a truncated file stay 0 */
+			file = (unsigned char *)resizebytes(file, available, needed);
+			if (fread(file + available, 1, needed - available, fd) < needed - available)
+				sampler_log(l, 3, "sampler~: %s: truncated", path);
+			available = needed;
+		}
+
+		data = (float *)getbytes((head ? head : 1) * sizeof(float));
+		wav.data = file + offset;
+		wav.frames = head;
+		samplebank_convert(data, &wav);
+		sample->data = data;
+		sample->length = frames;
+		sample->stream = 0;
+		if (head < frames)
+		{
+			stream = (t_sampler_stream *)getbytes(sizeof(t_sampler_stream));
+			stream->s_bank = l->l_bank;
+			stream->s_path = (char *)getbytes(strlen(path) + 1);
+			strcpy(stream->s_path, path);
+			stream->s_offset = offset + (long)head * framebytes;
+			stream->s_wav = wav;
+			stream->s_wav.data = 0;
+			stream->s_headlength = head;
+			sample->stream = stream;
+		}
+	}
+	if (error)
+		sampler_log(l, 1, "sampler~: %s: %s", path, error);
+
+	if (file)
+		freebytes(file, available);
+	fclose(fd);
+	return !error;
+}
+
+static void sampler_unmap(void *map, size_t size)
+{
+#ifdef _WIN32
+	(void)size;
+	UnmapViewOfFile(map);
+#else
+	munmap(map, size);
+#endif
+}
+
+/* Maps a bank file into memory. Returns NULL if it doesn't exist or can't be mapped. */
+static void *sampler_map(const char *path, size_t *size)
+{
+	void *map;
+#ifdef _WIN32
+	HANDLE file, mapping;
+	LARGE_INTEGER filesize;
+
+	if ((file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0)) == INVALID_HANDLE_VALUE)
+		return 0;
+	map = 0;
+	if (GetFileSizeEx(file, &filesize) && filesize.QuadPart > 0 && (mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0)))
+	{
+		map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+	*size = (size_t)filesize.QuadPart;
+#else
+	struct stat st;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return 0;
+	map = 0;
+	if (!fstat(fd, &st) && st.st_size > 0)
+	{
+		if ((map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+			map = 0;
+		else
+			madvise(map, st.st_size, MADV_WILLNEED); /* start reading, without waiting for it */
+	}
+	close(fd);
+	*size = (size_t)st.st_size;
+#endif
+	return map;
+}
+
+/* Frees the frames of a sample that was decoded from a WAV file. */
+static void sampler_freesample(t_sampler_sample *sample)
+{
+	t_sampler_stream *stream = sample->stream;
+	int head = stream ? stream->s_headlength : sample->length;
+	float *tail;
+
+	freebytes((void *)sample->data, (head ? head : 1) * sizeof(float));
+	if (stream)
+	{
+		if ((tail = atomic_load(&stream->s_tail)))
+			free(tail);
+		freebytes(stream->s_path, strlen(stream->s_path) + 1);
+		freebytes(stream, sizeof(t_sampler_stream));
+	}
+}
+
+/* ------------------------- streaming ---------------------------------------- */
+
+#ifndef _WIN32
+
+static pthread_t sampler_thread;
+static pthread_mutex_t sampler_lock = PTHREAD_MUTEX_INITIALIZER; /* held by the thread to fill the rings, and for every chunk it caches */
+static atomic_int sampler_running;
+static int sampler_numstreamed; /* streamed banks */
+
+/* Reads <n> frames of a tail as floats, or fewer if they don't fit in STREAM_CHUNK bytes.
+ * Frames that are missing from the file are 0. Returns the number of frames.
+ */
+static int sampler_readframes(int fd, float *out, const t_sampler_stream *stream, int frame, int n)
+{
+	unsigned char buffer[STREAM_CHUNK];
+	t_samplebank_wav wav = stream->s_wav;
+	int framebytes = wav.channels * (wav.bits / 8), i;
+	ssize_t got;
+
+	if (n > STREAM_CHUNK / framebytes)
+		n = STREAM_CHUNK / framebytes;
+	got = pread(fd, buffer, (size_t)n * framebytes, stream->s_offset + (off_t)frame * framebytes);
+	wav.data = buffer;
+	wav.frames = got > 0 ? (int)(got / framebytes) : 0;
+	samplebank_convert(out, &wav);
+	for (i = wav.frames; i < n; i++)
+		out[i] = 0;
+	return n;
+}
+
+/* Fills a ring up to RING_SIZE frames ahead of its voice. */
+static void sampler_fill(t_sampler_ring *ring)
+{
+	const t_sampler_sample *sample = ring->r_sample;
+	int length = sample->length - sample->stream->s_headlength, n;
+	int read = atomic_load_explicit(&ring->r_read, memory_order_acquire);
+	int write = atomic_load_explicit(&ring->r_write, memory_order_relaxed);
+
+	if (write < read)
+		write = read; /* the voice ran out of frames and went on without them */
+	while (write < length && write - read < RING_SIZE)
+	{
+		n = RING_SIZE - (write & (RING_SIZE - 1)); /* up to the end of the ring */
+		if (n > read + RING_SIZE - write)
+			n = read + RING_SIZE - write;
+		if (n > length - write)
+			n = length - write;
+		write += sampler_readframes(ring->r_fd, ring->r_frames + (write & (RING_SIZE - 1)), sample->stream, write, n);
+		atomic_store_explicit(&ring->r_write, write, memory_order_release);
+	}
+	atomic_store_explicit(&ring->r_write, write, memory_order_release);
+}
+
+/* FWN: Evicts the cached tail of the sample of <b> that was started least recently and
+ * is not playing. The audio thread counts itself as a user before it takes s_tail, so a
+ * tail is only freed if no voice can have taken it. Returns 0 if no tail can be evicted.
+ */
+static int sampler_evict(t_sampler_bank *b, const t_sampler_stream *keep)
+{
+	t_sampler_sample *sample, *victim = 0;
+	t_sampler_stream *stream;
+	unsigned int lastused = 0;
+	float *tail;
+	int i;
+
+	for (i = 0; i < b->b_tablesize; i++)
+	{
+		sample = &b->b_table[i];
+		if (!sample->name || !(stream = sample->stream) || stream == keep || !atomic_load(&stream->s_tail) || atomic_load(&stream->s_users))
+			continue;
+		if (!victim || atomic_load_explicit(&stream->s_lastused, memory_order_relaxed) < lastused)
+		{
+			victim = sample;
+			lastused = atomic_load_explicit(&stream->s_lastused, memory_order_relaxed);
+		}
+	}
+	if (!victim)
+		return 0;
+	stream = victim->stream;
+	tail = atomic_exchange(&stream->s_tail, 0);
+	if (atomic_load(&stream->s_users))
+	{
+		atomic_store(&stream->s_tail, tail); /* a voice has just started it */
+		return 0;
+	}
+	free(tail);
+	b->b_cached -= (size_t)(victim->length - stream->s_headlength) * sizeof(float);
+	return 1;
+}
+
+/* FWN: Reads the next RING_SIZE frames of the tail of the sample of a ring into the cache,
+ * if it fits in the budget. A tail is read a chunk a round, and the lock is let go between
+ * the chunks, so that a long tail doesn't hold up the other rings or the Pd thread. Its
+ * bytes are counted in b_cached from the first chunk, and it is cached after the last one.
+ */
+static void sampler_cache(t_sampler_ring *ring)
+{
+	const t_sampler_sample *sample = ring->r_sample;
+	t_sampler_stream *stream = sample->stream;
+	t_sampler_bank *b = stream->s_bank;
+	int length = sample->length - stream->s_headlength, end;
+	size_t bytes = (size_t)length * sizeof(float);
+
+	if (!ring->r_tail)
+	{
+		ring->r_cached = 1;
+		if (atomic_load(&stream->s_tail) || stream->s_caching || bytes > b->b_budget)
+			return;
+		while (b->b_cached + bytes > b->b_budget)
+			if (!sampler_evict(b, stream))
+				return;
+		if (!(ring->r_tail = (float *)malloc(bytes)))
+			return;
+		ring->r_tailframes = 0;
+		stream->s_caching = 1;
+		b->b_cached += bytes;
+	}
+	end = ring->r_tailframes + RING_SIZE < length ? ring->r_tailframes + RING_SIZE : length;
+	while (ring->r_tailframes < end)
+		ring->r_tailframes += sampler_readframes(ring->r_fd, ring->r_tail + ring->r_tailframes, stream, ring->r_tailframes, end - ring->r_tailframes);
+	if (ring->r_tailframes == length)
+	{
+		stream->s_caching = 0;
+		atomic_store(&stream->s_tail, ring->r_tail);
+		ring->r_tail = 0;
+	}
+}
+
+/* Gives up on the tail that a ring was reading into the cache, when its voice has ended. */
+static void sampler_uncache(t_sampler_ring *ring)
+{
+	t_sampler_stream *stream = ring->r_sample->stream;
+
+	if (!ring->r_tail)
+		return;
+	free(ring->r_tail);
+	ring->r_tail = 0;
+	stream->s_caching = 0;
+	stream->s_bank->b_cached -= (size_t)(ring->r_sample->length - stream->s_headlength) * sizeof(float);
+}
+
+static void sampler_serve(t_sampler_ring *ring)
+{
+	int state = atomic_load_explicit(&ring->r_state, memory_order_acquire);
+
+	if (state == kRingReleased)
+	{
+		if (ring->r_fd >= 0)
+			close(ring->r_fd);
+		ring->r_fd = -1;
+		ring->r_cached = 0;
+		sampler_uncache(ring);
+		atomic_store_explicit(&ring->r_state, kRingIdle, memory_order_release);
+	}
+	else if (state == kRingActive)
+	{
+		if (ring->r_fd < 0 && (ring->r_fd = open(ring->r_sample->stream->s_path, O_RDONLY)) < 0)
+			return; /* the voice plays silence, and we try again in the next round */
+		sampler_fill(ring);
+	}
+}
+
+/* FWN: The streaming thread. It polls the rings instead of being woken up, because the
+ * audio thread must not take a lock, and a round every kStreamPoll ms is far sooner than
+ * the kHeadTime ms that the head of a sample plays for.
+ */
+static void *sampler_stream(void *arg)
+{
+	struct timespec poll = {0, kStreamPoll * 1000000L};
+	int r;
+
+	(void)arg;
+	while (atomic_load(&sampler_running))
+	{
+		pthread_mutex_lock(&sampler_lock);
+		for (r = 0; r < MAX_RINGS; r++)
+			sampler_serve(&sampler_rings[r]);
+		pthread_mutex_unlock(&sampler_lock);
+
+		// FWN: Every ring has been filled, now read a chunk of each tail that is being cached.
+		for (r = 0; r < MAX_RINGS; r++)
+		{
+			pthread_mutex_lock(&sampler_lock);
+			if (atomic_load_explicit(&sampler_rings[r].r_state, memory_order_acquire) == kRingActive && sampler_rings[r].r_fd >= 0
+				&& (!sampler_rings[r].r_cached || sampler_rings[r].r_tail))
+				sampler_cache(&sampler_rings[r]);
+			pthread_mutex_unlock(&sampler_lock);
+		}
+		nanosleep(&poll, 0);
+	}
+	return 0;
+}
+
+/* Starts the streaming thread for the first streamed bank. Returns 0 if it can't. */
+static int sampler_startstreaming(void)
+{
+	int r;
+
+	if (sampler_numstreamed)
+	{
+		sampler_numstreamed++;
+		return 1;
+	}
+	sampler_rings = (t_sampler_ring *)getbytes(MAX_RINGS * sizeof(t_sampler_ring));
+	for (r = 0; r < MAX_RINGS; r++)
+		sampler_rings[r].r_fd = -1;
+	atomic_store(&sampler_running, 1);
+	if (pthread_create(&sampler_thread, 0, sampler_stream, 0))
+	{
+		freebytes(sampler_rings, MAX_RINGS * sizeof(t_sampler_ring));
+		sampler_rings = 0;
+		return 0;
+	}
+	sampler_numstreamed = 1;
+	return 1;
+}
+
+/* Stops the streaming thread after the last streamed bank, or waits until it is between rounds. */
+static void sampler_stopstreaming(void)
+{
+	int r;
+
+	if (--sampler_numstreamed)
+	{
+		pthread_mutex_lock(&sampler_lock);
+		for (r = 0; r < MAX_RINGS; r++)
+			if (atomic_load(&sampler_rings[r].r_state) == kRingReleased)
+				sampler_serve(&sampler_rings[r]);
+		pthread_mutex_unlock(&sampler_lock);
+		return;
+	}
+	atomic_store(&sampler_running, 0);
+	pthread_join(sampler_thread, 0);
+	for (r = 0; r < MAX_RINGS; r++)
+	{
+		if (sampler_rings[r].r_fd >= 0)
+			close(sampler_rings[r].r_fd);
+		if (sampler_rings[r].r_tail)
+			sampler_uncache(&sampler_rings[r]);
+	}
+	freebytes(sampler_rings, MAX_RINGS * sizeof(t_sampler_ring));
+	sampler_rings = 0;
+}
+
+#endif /* _WIN32 */
+
+static void sampler_bank_free(t_sampler_bank *b)
+{
+	t_sampler_bank **p;
+	int i;
+
+	for (p = &sampler_banks; *p; p = &(*p)->b_next)
+		if (*p == b)
+		{
+			*p = b->b_next;
+			break;
+		}
+#ifndef _WIN32
+	if (b->b_streamed)
+		sampler_stopstreaming();
+#endif
+	if (b->b_map)
+		sampler_unmap(b->b_map, b->b_mapsize);
+	else
+		for (i = 0; i < b->b_tablesize; i++)
+			if (b->b_table[i].name)
+				sampler_freesample(&b->b_table[i]);
+	if (b->b_table)
+		freebytes(b->b_table, b->b_tablesize * sizeof(t_sampler_sample));
+	freebytes(b, sizeof(t_sampler_bank));
+}
+
+/* Inserts a decoded sample into the table, replacing one with the same name. */
+static void sampler_bank_add(t_sampler_bank *b, t_sampler_sample *sample)
+{
+	unsigned int mask, slot;
+	t_sampler_sample *old;
+	int i;
+
+	if (2 * (b->b_numsamples + 1) > b->b_tablesize)
+	{
+		/* keep the table at most half full */
+		old = b->b_table;
+		i = b->b_tablesize;
+		b->b_tablesize = i ? 2 * i : 64;
+		b->b_table = (t_sampler_sample *)getbytes(b->b_tablesize * sizeof(t_sampler_sample));
+		b->b_numsamples = 0;
+		while (i--)
+			if (old[i].name)
+				sampler_bank_add(b, &old[i]);
+		if (old)
+			freebytes(old, (b->b_tablesize / 2) * sizeof(t_sampler_sample));
+	}
+
+	mask = (unsigned int)b->b_tablesize - 1;
+	for (slot = pdfiles_hash(sample->name) & mask; b->b_table[slot].name; slot = (slot + 1) & mask)
+		if (b->b_table[slot].name == sample->name)
+		{
+			if (!b->b_map)
+				sampler_freesample(&b->b_table[slot]);
+			b->b_numsamples--;
+			break;
+		}
+	b->b_table[slot] = *sample;
+	b->b_numsamples++;
+}
+
+/* Checks that every block of a kBankBlock body lies inside the body. */
+static int sampler_checkblocks(const unsigned char *data, uint64_t size, uint32_t frames)
+{
+	uint32_t numblocks = (frames + BANK_BLOCK - 1) / BANK_BLOCK, block, entry, n;
+
+	if ((uint64_t)numblocks * 4 > size)
+		return 0;
+	for (block = 0; block < numblocks; block++)
+	{
+		memcpy(&entry, data + 4 * block, 4);
+		n = frames - block * BANK_BLOCK < BANK_BLOCK ? frames - block * BANK_BLOCK : BANK_BLOCK;
+		if ((entry & ~3u) + 4 + (uint64_t)(n - 1) * ((entry & 3) + 1) > size)
+			return 0;
+	}
+	return 1;
+}
+
+/* Checks a mapped bank file and keeps its samples. Returns 0 and logs why if it is not usable. */
+static int sampler_bank_readmap(t_sampler_load *l, const char *path)
+{
+	t_sampler_bank *b = l->l_bank;
+	const unsigned char *map = (const unsigned char *)b->b_map;
+	const t_samplebank_header *header = (const t_samplebank_header *)map;
+	const t_samplebank_entry *entries;
+	const t_samplebank_body *bodies, *body;
+	t_sampler_sample sample;
+	size_t size = b->b_mapsize, index;
+	uint32_t i;
+
+	if (size < sizeof(t_samplebank_header) || header->magic != kBankMagic)
+	{
+		sampler_log(l, 1, "sampler~: %s: not a sample bank, or from a machine with another byte order", path);
+		return 0;
+	}
+	index = sizeof(t_samplebank_header) + (size_t)header->numentries * sizeof(t_samplebank_entry) + (size_t)header->numbodies * sizeof(t_samplebank_body);
+	if (header->version != kBankVersion || header->format > kBankBlock || header->size != size || index > size)
+	{
+		sampler_log(l, 1, "sampler~: %s: wrong version or truncated, run \"make bank\" again", path);
+		return 0;
+	}
+	entries = (const t_samplebank_entry *)(map + sizeof(t_samplebank_header));
+	bodies = (const t_samplebank_body *)(entries + header->numentries);
+	for (i = 0; i < header->numbodies; i++)
+		if (bodies[i].offset < index || bodies[i].offset % kBankAlign || bodies[i].offset > size || bodies[i].size > size - bodies[i].offset ||
+			(header->format == kBankBlock ? !sampler_checkblocks(map + bodies[i].offset, bodies[i].size, bodies[i].frames)
+										  : bodies[i].frames > bodies[i].size / samplebank_framesize(header->format)))
+		{
+			sampler_log(l, 1, "sampler~: %s: damaged, run \"make bank\" again", path);
+			return 0;
+		}
+	for (i = 0; i < header->numbodies; i++)
+		if (bodies[i].frames && (int)bodies[i].samplerate != l->l_samplerate)
+		{
+			sampler_log(l, 3, "sampler~: %s is at %u Hz and Pd at %d Hz, so the WAV files are converted instead; \"make bank BANKRATE=%d\" makes a bank at this rate",
+						path, bodies[i].samplerate, l->l_samplerate, l->l_samplerate);
+			return 0;
+		}
+
+	b->b_format = (int)header->format;
+	for (i = 0; i < header->numentries; i++)
+	{
+		if (entries[i].body >= header->numbodies || !memchr(entries[i].name, 0, BANK_NAME_SIZE))
+			continue;
+		body = &bodies[entries[i].body];
+		sample.name = 0;
+		sample.data = map + body->offset;
+		sample.length = (int)body->frames;
+		sample.stream = 0;
+		sampler_loaded(l, entries[i].name, (int)strlen(entries[i].name), &sample);
+	}
+	return 1;
+}
+
+static t_sampler_bank *sampler_bank_new(t_symbol *dir)
+{
+	t_sampler_bank *b = (t_sampler_bank *)getbytes(sizeof(t_sampler_bank));
+	b->b_dir = dir;
+	b->b_refcount = 1;
+	b->b_format = kBankFloat32;
+	return b;
+}
+
+/* Maps a packed bank file into an empty bank. Returns 0 if there is none or it is damaged. */
+static int sampler_bank_mapfile(t_sampler_load *l, const char *path)
+{
+	t_sampler_bank *b = l->l_bank;
+
+	if (!(b->b_map = sampler_map(path, &b->b_mapsize)))
+		return 0;
+	if (sampler_bank_readmap(l, path))
+	{
+		sampler_log(l, 3, "sampler~: mapped %d samples from %s", l->l_numsamples, path);
+		return 1;
+	}
+	sampler_unmap(b->b_map, b->b_mapsize);
+	b->b_map = 0;
+	b->b_format = kBankFloat32;
+	return 0;
+}
+
+/* Milliseconds from some fixed time, to measure loading. */
+static double sampler_now(void)
+{
+#ifdef _WIN32
+	return (double)GetTickCount64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+#endif
+}
+
+/* FWN: The WAV files of a directory, which the decoders take one at a time. */
+typedef struct
+{
+	t_sampler_load *w_load;
+	const char *w_dir;
+	char **w_files;
+	t_sampler_sample *w_samples;
+	char *w_ok; /* whether each file could be read */
+	int w_numfiles;
+	atomic_int w_next; /* the next file to decode */
+} t_sampler_work;
+
+static void *sampler_decode(void *arg)
+{
+	t_sampler_work *w = (t_sampler_work *)arg;
+	char path[MAXPDSTRING];
+	double start;
+	int i;
+
+	while ((i = atomic_fetch_add(&w->w_next, 1)) < w->w_numfiles)
+	{
+		snprintf(path, sizeof(path), "%s/%s", w->w_dir, w->w_files[i]);
+		start = sampler_now();
+		if (w->w_load->l_bank->b_format == kSamplerStream)
+			w->w_ok[i] = (char)sampler_readhead(w->w_load, path, &w->w_samples[i]);
+		else
+			w->w_ok[i] = (char)sampler_readwav(w->w_load, path, &w->w_samples[i]);
+		sampler_log(w->w_load, 4, "sampler~: %s: %.1f ms", path, sampler_now() - start);
+	}
+	return 0;
+}
+
+/* FWN: Decodes every WAV file in a directory into an empty bank. Returns 0 if the
+ * directory can't be opened. The files are decoded by up to MAX_DECODERS threads, one per
+ * core, which take the next file when they are done with one.
+ */
+static int sampler_bank_readwavs(t_sampler_load *l, const char *dir)
+{
+	t_sampler_work w;
+	t_pdfiles_dir dp;
+	const char *filename;
+	int maxfiles = 0, numthreads = 1, len, i;
+	double start = sampler_now();
+#ifndef _WIN32
+	pthread_t threads[MAX_DECODERS];
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int started = 0;
+#endif
+
+	if (!pdfiles_opendir(&dp, dir, ".wav"))
+	{
+		sampler_log(l, 1, "sampler~: %s: can't open directory", dir);
+		return 0;
+	}
+	memset(&w, 0, sizeof(w));
+	w.w_load = l;
+	w.w_dir = dir;
+	while ((filename = pdfiles_readdir(&dp)))
+	{
+		len = (int)strlen(filename);
+		if (len <= 4 || strcmp(filename + len - 4, ".wav"))
+			continue;
+		if (w.w_numfiles == maxfiles)
+		{
+			w.w_files = (char **)resizebytes(w.w_files, maxfiles * sizeof(char *), (maxfiles * 2 + 64) * sizeof(char *));
+			maxfiles = maxfiles * 2 + 64;
+		}
+		w.w_files[w.w_numfiles] = (char *)getbytes(len + 1);
+		memcpy(w.w_files[w.w_numfiles++], filename, len);
+	}
+	pdfiles_closedir(&dp);
+	w.w_samples = (t_sampler_sample *)getbytes((w.w_numfiles ? w.w_numfiles : 1) * sizeof(t_sampler_sample));
+	w.w_ok = (char *)getbytes(w.w_numfiles ? w.w_numfiles : 1);
+
+	// FWN: This thread decodes too, so it starts one thread less than there are decoders.
+#ifndef _WIN32
+	numthreads = cores < 1 ? 1 : cores > MAX_DECODERS ? MAX_DECODERS : (int)cores;
+	if (numthreads > w.w_numfiles)
+		numthreads = w.w_numfiles ? w.w_numfiles : 1;
+	while (started < numthreads - 1 && !pthread_create(&threads[started], 0, sampler_decode, &w))
+		started++;
+	numthreads = started + 1;
+#endif
+	sampler_decode(&w);
+#ifndef _WIN32
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], 0);
+#endif
+
+	for (i = 0; i < w.w_numfiles; i++)
+	{
+		if (w.w_ok[i])
+		{
+			w.w_samples[i].name = 0;
+			sampler_loaded(l, w.w_files[i], (int)strlen(w.w_files[i]) - 4, &w.w_samples[i]);
+		}
+		freebytes(w.w_files[i], strlen(w.w_files[i]) + 1);
+	}
+	if (w.w_files)
+		freebytes(w.w_files, maxfiles * sizeof(char *));
+	freebytes(w.w_samples, (w.w_numfiles ? w.w_numfiles : 1) * sizeof(t_sampler_sample));
+	freebytes(w.w_ok, w.w_numfiles ? w.w_numfiles : 1);
+
+	sampler_log(l, 3, "sampler~: loaded %d samples from %s in %.0f ms with %d threads", l->l_numsamples, dir, sampler_now() - start, numthreads);
+	if (atomic_load(&l->l_unconverted))
+		sampler_log(l, 1, "sampler~: %s: %d streamed samples are not at %d Hz and play at the wrong pitch; load them without a budget to convert them", dir,
+					atomic_load(&l->l_unconverted), l->l_samplerate);
+	return 1;
+}
+
+/* FWN: Starts streaming the tails of a bank whose heads have been read, with what the
+ * heads and the rings leave of <budget> bytes for the cache.
+ */
+static void sampler_bank_stream(void *owner, t_sampler_bank *b, size_t budget)
+{
+	size_t resident = MAX_RINGS * sizeof(t_sampler_ring);
+	int i, streamed = 0;
+
+	for (i = 0; i < b->b_tablesize; i++)
+		if (b->b_table[i].name)
+		{
+			streamed += (b->b_table[i].stream != 0);
+			resident += (b->b_table[i].stream ? b->b_table[i].stream->s_headlength : b->b_table[i].length) * sizeof(float);
+		}
+	if (resident > budget)
+		pd_error(owner, "sampler~: %s: the heads of the samples take %.1f MB, more than the budget, so no tails are cached", b->b_dir->s_name, resident / 1048576.0);
+	b->b_budget = resident < budget ? budget - resident : 0;
+#ifndef _WIN32
+	if (!(b->b_streamed = sampler_startstreaming()))
+		pd_error(owner, "sampler~: can't start the streaming thread, only the heads will play");
+#endif
+	logpost(owner, 3, "sampler~: streaming %d of %d samples, %.1f MB in memory and %.1f MB for the cache", streamed, b->b_numsamples, resident / 1048576.0,
+			b->b_budget / 1048576.0);
+}
+
+static t_sampler_load *sampler_load_new(t_symbol *dir, t_float budget)
+{
+	t_sampler_load *l = (t_sampler_load *)getbytes(sizeof(t_sampler_load));
+	l->l_bank = sampler_bank_new(dir);
+	l->l_bank->b_samplerate = l->l_samplerate = (int)sys_getsr();
+	l->l_budget = budget;
+	return l;
+}
+
+/* FWN: Loads the bank of a directory, in Pd's thread or in the thread of "open". */
+static void sampler_load_run(t_sampler_load *l)
+{
+	t_sampler_bank *b = l->l_bank;
+	char path[MAXPDSTRING];
+
+#ifdef _WIN32
+	if (l->l_budget > 0)
+	{
+		sampler_log(l, 3, "sampler~: streaming is not available on Windows, all samples are loaded");
+		l->l_budget = 0;
+	}
+#endif
+	if (l->l_budget > 0)
+	{
+		b->b_format = kSamplerStream;
+		l->l_ok = sampler_bank_readwavs(l, b->b_dir->s_name);
+	}
+	else
+	{
+		// FWN: Prefer a packed bank, and fall back to the WAV files if there is none or it is damaged.
+		snprintf(path, sizeof(path), "%s.bank", b->b_dir->s_name);
+		l->l_ok = sampler_bank_mapfile(l, path) || sampler_bank_readwavs(l, b->b_dir->s_name);
+	}
+	atomic_store_explicit(&l->l_done, 1, memory_order_release);
+}
+
+#ifndef _WIN32
+static void *sampler_loader(void *l)
+{
+	sampler_load_run((t_sampler_load *)l);
+	return 0;
+}
+#endif
+
+/* FWN: Posts the messages of a bank that has been loaded, names its samples and makes it
+ * available to every sampler~. Returns the bank, or NULL if it couldn't be loaded.
+ */
+static t_sampler_bank *sampler_load_finish(void *owner, t_sampler_load *l)
+{
+	t_sampler_bank *b = l->l_bank;
+	char *line, *end;
+	int i;
+
+	for (line = l->l_log; line && line < l->l_log + l->l_logsize; line = end + 1)
+	{
+		end = memchr(line, '\n', l->l_log + l->l_logsize - line);
+		*end = 0;
+		if (line[0] == '1')
+			pd_error(owner, "%s", line + 1);
+		else
+			logpost(owner, line[0] - '0', "%s", line + 1);
+	}
+	for (i = 0; i < l->l_numsamples; i++)
+	{
+		l->l_samples[i].n_sample.name = gensym(l->l_samples[i].n_name);
+		if (l->l_ok)
+			sampler_bank_add(b, &l->l_samples[i].n_sample);
+		else if (!b->b_map)
+			sampler_freesample(&l->l_samples[i].n_sample);
+		freebytes(l->l_samples[i].n_name, strlen(l->l_samples[i].n_name) + 1);
+	}
+	if (l->l_samples)
+		freebytes(l->l_samples, l->l_maxsamples * sizeof(t_sampler_named));
+	if (l->l_log)
+		freebytes(l->l_log, l->l_logsize);
+
+	if (!l->l_ok)
+	{
+		sampler_bank_free(b);
+		b = 0;
+	}
+	else
+	{
+		if (b->b_format == kSamplerStream)
+			sampler_bank_stream(owner, b, (size_t)(l->l_budget * 1048576));
+		b->b_next = sampler_banks;
+		sampler_banks = b;
+	}
+	freebytes(l, sizeof(t_sampler_load));
+	return b;
+}
+
+/* The bank of a directory that was loaded at the current sample rate. */
+static t_sampler_bank *sampler_bank_find(t_symbol *dir)
+{
+	t_sampler_bank *b;
+
+	for (b = sampler_banks; b; b = b->b_next)
+		if (b->b_dir == dir && b->b_samplerate == (int)sys_getsr())
+			return b;
+	return 0;
+}
+
+/* Returns the bank for a directory, loading it if no other sampler~ has. */
+static t_sampler_bank *sampler_bank_get(void *owner, t_symbol *dir, t_float budget)
+{
+	t_sampler_bank *b;
+	t_sampler_load *l;
+
+	if ((b = sampler_bank_find(dir)))
+	{
+		b->b_refcount++;
+		return b;
+	}
+	l = sampler_load_new(dir, budget);
+	sampler_load_run(l);
+	return sampler_load_finish(owner, l);
+}
+
+/* FWN: Lets go of a bank. A bank that no sampler~ uses is freed at once if none of its
+ * voices are playing, and otherwise by sampler_reap when the last of them has ended.
+ */
+static void sampler_bank_release(t_sampler_bank *b)
+{
+	t_sampler_bank **p;
+
+	if (!b || --b->b_refcount)
+		return;
+	if (!b->b_voices)
+	{
+		sampler_bank_free(b);
+		return;
+	}
+	for (p = &sampler_banks; *p; p = &(*p)->b_next)
+		if (*p == b)
+		{
+			*p = b->b_next;
+			break;
+		}
+	b->b_next = sampler_retired;
+	sampler_retired = b;
+}
+
+static void sampler_reap(void *dummy)
+{
+	t_sampler_bank **p = &sampler_retired, *b;
+
+	(void)dummy;
+	while ((b = *p))
+		if (!b->b_voices)
+		{
+			*p = b->b_next;
+			sampler_bank_free(b);
+		}
+		else
+			p = &b->b_next;
+}
+
+/* FWN: Returns up to <n> frames of a voice of a streamed bank, from the head, the cached
+ * tail or the ring. If the streaming thread has fallen behind, the voice plays silence
+ * instead of waiting for it.
+ */
+static const float *sampler_streamframes(t_sampler_pool *p, int v, int *n)
+{
+	const t_sampler_sample *sample = p->p_sample[v];
+	int position = p->p_position[v], head = sample->stream ? sample->stream->s_headlength : sample->length, index, available, i;
+
+	if (position < head)
+	{
+		if (*n > head - position)
+			*n = head - position;
+		return (const float *)sample->data + position;
+	}
+	index = position - head;
+	if (p->p_tail[v])
+		return p->p_tail[v] + index;
+	available = atomic_load_explicit(&p->p_ring[v]->r_write, memory_order_acquire) - index;
+	if (available <= 0)
+	{
+		for (i = 0; i < *n; i++)
+			p->p_frames[v][i] = 0;
+		return p->p_frames[v];
+	}
+	if (*n > available)
+		*n = available;
+	if (*n > RING_SIZE - (index & (RING_SIZE - 1)))
+		*n = RING_SIZE - (index & (RING_SIZE - 1));
+	return p->p_ring[v]->r_frames + (index & (RING_SIZE - 1));
+}
+
+/* FWN: Returns up to <n> frames (at most BANK_BLOCK) of a voice as floats, decoding or
+ * converting them into p_frames if they are not stored as floats. Returns the number of
+ * frames in <n>.
+ */
+static const float *sampler_frames(t_sampler_pool *p, int v, int *n)
+{
+	const t_sampler_sample *sample = p->p_sample[v];
+	int position = p->p_position[v], block, offset, frames, i;
+
+	if (*n > BANK_BLOCK)
+		*n = BANK_BLOCK;
+	if (p->p_format[v] == kBankBlock)
+	{
+		block = position / BANK_BLOCK;
+		offset = position % BANK_BLOCK;
+		if (block != p->p_block[v])
+		{
+			frames = sample->length - block * BANK_BLOCK;
+			samplebank_decodeblock(p->p_frames[v], (const unsigned char *)sample->data, block, frames < BANK_BLOCK ? frames : BANK_BLOCK);
+			p->p_block[v] = block;
+		}
+		if (*n > BANK_BLOCK - offset)
+			*n = BANK_BLOCK - offset;
+		return p->p_frames[v] + offset;
+	}
+	else if (p->p_format[v] == kSamplerStream)
+		return sampler_streamframes(p, v, n);
+	else if (p->p_format[v] == kBankInt16)
+	{
+		const int16_t *data = (const int16_t *)sample->data + position;
+		for (i = 0; i < *n; i++)
+			p->p_frames[v][i] = data[i] * (1.f / 32768);
+		return p->p_frames[v];
+	}
+	return (const float *)sample->data + position;
+}
+
+/* Frees a voice, and the tail or the ring that it played from. */
+static void sampler_endvoice(t_sampler_pool *p, int v)
+{
+	// FWN: The last voice of a bank that was swapped out lets sampler_reap free it after this block.
+	if (!--p->p_bank[v]->b_voices && !p->p_bank[v]->b_refcount)
+		clock_delay(sampler_reaper, 0);
+	if (p->p_tail[v])
+		atomic_fetch_sub(&p->p_sample[v]->stream->s_users, 1);
+	if (p->p_ring[v])
+		atomic_store_explicit(&p->p_ring[v]->r_state, kRingReleased, memory_order_release);
+	p->p_tail[v] = 0;
+	p->p_ring[v] = 0;
+	p->p_owner[v] = 0;
+}
+
+/* FWN: Adds a voice to the output, applying its gain as a ramp while it fades out. */
+static void sampler_mix(t_sampler_pool *p, int v, t_sample *out, int n)
+{
+	const float *frames;
+	float gain, step, peak = 0, y;
+	int chunk, played = n, i;
+
+	if (p->p_delay[v])
+	{
+		chunk = p->p_delay[v] < n ? p->p_delay[v] : n;
+		p->p_delay[v] -= chunk;
+		out += chunk;
+		if (!(n -= chunk))
+			return; /* not started yet, so not quiet either */
+		played = n;
+	}
+	while (n > 0 && p->p_owner[v])
+	{
+		chunk = p->p_length[v] - p->p_position[v];
+		if (chunk > n)
+			chunk = n;
+		if (p->p_fade[v] && chunk > p->p_fade[v])
+			chunk = p->p_fade[v];
+		frames = sampler_frames(p, v, &chunk);
+
+		gain = p->p_gain[v];
+		step = p->p_step[v];
+		for (i = 0; i < chunk; i++)
+		{
+			y = frames[i] * (gain + step * i);
+			out[i] += y;
+			peak = fmaxf(peak, fabsf(y));
+		}
+		p->p_gain[v] = gain + step * chunk;
+		p->p_position[v] += chunk;
+		out += chunk;
+		n -= chunk;
+		if (p->p_ring[v] && p->p_position[v] > p->p_sample[v]->stream->s_headlength)
+			atomic_store_explicit(&p->p_ring[v]->r_read, p->p_position[v] - p->p_sample[v]->stream->s_headlength, memory_order_release);
+
+		if (p->p_fade[v] && !(p->p_fade[v] -= chunk))
+			sampler_endvoice(p, v); /* faded out */
+		else if (p->p_position[v] >= p->p_length[v])
+			sampler_endvoice(p, v);
+	}
+	p->p_level[v] = peak;
+	p->p_peak[v] = fmaxf(p->p_peak[v], peak);
+
+	// FWN: End a voice that has died away, rather than play its silent tail.
+	if (p->p_owner[v] && (p->p_quiet[v] = peak < kSilence * p->p_peak[v] ? p->p_quiet[v] + played : 0) >= p->p_quietlength)
+		sampler_endvoice(p, v);
+}
+
+/* Starts fading out a voice. */
+static void sampler_release(t_sampler_pool *p, int v)
+{
+	if (p->p_fade[v])
+		return;
+	p->p_fade[v] = p->p_fadelength;
+	p->p_step[v] = -p->p_gain[v] / p->p_fadelength;
+}
+
+/* FWN: Returns the voice to steal among the voices of <owner> that are not fading out, or
+ * among all of them if <owner> is NULL, and the number of those voices in <count>.
+ */
+static int sampler_victim(t_sampler_pool *p, t_sampler *owner, int *count)
+{
+	int v, victim = -1;
+
+	*count = 0;
+	for (v = 0; v < MAX_VOICES; v++)
+	{
+		if (!p->p_owner[v] || p->p_fade[v] || (owner && p->p_owner[v] != owner))
+			continue;
+		(*count)++;
+		if (victim < 0)
+			victim = v;
+		else if (p->p_steal == kStealQuietest && p->p_level[v] != p->p_level[victim])
+		{
+			if (p->p_level[v] < p->p_level[victim])
+				victim = v;
+		}
+		else if (p->p_count - p->p_start[v] > p->p_count - p->p_start[victim])
+			victim = v; /* older */
+	}
+	return victim;
+}
+
+/* FWN: Finds the rest of a streamed sample for a voice: its tail if it is in the cache,
+ * or else a ring for the streaming thread to fill. If all rings are taken, the voice
+ * plays only the head.
+ */
+static void sampler_startstream(t_sampler_pool *p, int v)
+{
+	t_sampler_stream *stream = p->p_sample[v]->stream;
+	const float *tail;
+	int r;
+
+	atomic_store_explicit(&stream->s_lastused, p->p_start[v], memory_order_relaxed);
+	atomic_fetch_add(&stream->s_users, 1);
+	if ((tail = atomic_load(&stream->s_tail)))
+	{
+		p->p_tail[v] = tail;
+		return;
+	}
+	atomic_fetch_sub(&stream->s_users, 1);
+
+	for (r = 0; sampler_rings && r < MAX_RINGS; r++)
+		if (atomic_load_explicit(&sampler_rings[r].r_state, memory_order_acquire) == kRingIdle)
+		{
+			sampler_rings[r].r_sample = p->p_sample[v];
+			atomic_store_explicit(&sampler_rings[r].r_read, 0, memory_order_relaxed);
+			atomic_store_explicit(&sampler_rings[r].r_write, 0, memory_order_relaxed);
+			atomic_store_explicit(&sampler_rings[r].r_state, kRingActive, memory_order_release);
+			p->p_ring[v] = &sampler_rings[r];
+			return;
+		}
+	p->p_length[v] = stream->s_headlength;
+}
+
+/* Starts a voice of <x> that plays <sample> after <delay> samples of the next block. */
+static void sampler_start(t_sampler *x, t_sampler_sample *sample, int delay)
+{
+	t_sampler_pool *p = &sampler_pool;
+	int v, voice = -1, victim, count;
+
+	// FWN: Make room in the object and in the pool.
+	if ((victim = sampler_victim(p, x, &count)) >= 0 && count >= x->x_numvoices)
+		sampler_release(p, victim);
+	if ((victim = sampler_victim(p, 0, &count)) >= 0 && count >= p->p_limit)
+		sampler_release(p, victim);
+
+	// FWN: Use a free voice, or else cut the voice that is closest to the end of its fade.
+	for (v = 0; v < MAX_VOICES; v++)
+	{
+		if (!p->p_owner[v])
+		{
+			voice = v;
+			break;
+		}
+		if (p->p_fade[v] && (voice < 0 || p->p_fade[v] < p->p_fade[voice]))
+			voice = v;
+	}
+	if (voice < 0)
+		voice = sampler_victim(p, 0, &count);
+	if (p->p_owner[voice])
+		sampler_endvoice(p, voice);
+
+	p->p_owner[voice] = x;
+	p->p_bank[voice] = x->x_bank;
+	x->x_bank->b_voices++;
+	p->p_sample[voice] = sample;
+	p->p_format[voice] = x->x_bank->b_format;
+	p->p_position[voice] = 0;
+	p->p_delay[voice] = delay;
+	p->p_start[voice] = p->p_count++;
+	p->p_gain[voice] = 1;
+	p->p_step[voice] = 0;
+	p->p_fade[voice] = 0;
+	p->p_level[voice] = 1; /* not quiet before it has played */
+	p->p_peak[voice] = 0;
+	p->p_quiet[voice] = 0;
+	p->p_block[voice] = -1;
+	p->p_length[voice] = sample->length;
+	if (sample->stream)
+		sampler_startstream(p, voice);
+}
+
+static t_sampler_sample *sampler_get(t_sampler *x, t_symbol *s)
+{
+	t_sampler_sample *sample = x->x_bank ? sampler_find(x->x_bank, s) : 0;
+
+	if (!sample)
+		pd_error(x, "sampler~: %s: no such sample", s->s_name);
+	return sample;
+}
+
+static void sampler_play(t_sampler *x, t_symbol *s)
+{
+	t_sampler_sample *sample = sampler_get(x, s);
+
+	if (sample)
+		sampler_start(x, sample, 0);
+}
+
+static void sampler_set(t_sampler *x, t_symbol *s)
+{
+	t_sampler_sample *sample = sampler_get(x, s);
+
+	if (sample)
+		x->x_next = sample;
+}
+
+static void sampler_stop(t_sampler *x)
+{
+	int v;
+	for (v = 0; v < MAX_VOICES; v++)
+		if (sampler_pool.p_owner[v] == x)
+			sampler_release(&sampler_pool, v);
+}
+
+static void sampler_setpool(t_sampler *x, t_floatarg f)
+{
+	(void)x;
+	sampler_pool.p_limit = f < 1 ? 1 : f > MAX_VOICES ? MAX_VOICES : (int)f;
+}
+
+static void sampler_steal(t_sampler *x, t_symbol *s)
+{
+	if (s == gensym("quietest"))
+		sampler_pool.p_steal = kStealQuietest;
+	else if (s == gensym("oldest"))
+		sampler_pool.p_steal = kStealOldest;
+	else
+		pd_error(x, "sampler~: steal: expected quietest or oldest");
+}
+
+static t_int *sampler_perform(t_int *w)
+{
+	t_sampler *x = (t_sampler *)(w[1]);
+	t_sample *in = (t_sample *)(w[2]);
+	t_sample *out = (t_sample *)(w[3]);
+	int n = (int)(w[4]);
+	t_sampler_pool *p = &sampler_pool;
+	int i, v;
+
+	// FWN: Start the voices first, the output may be the same vector as the input.
+	for (i = 0; i < n; i++)
+		if (in[i] != 0 && x->x_next)
+			sampler_start(x, x->x_next, i);
+
+	for (i = 0; i < n; i++)
+		out[i] = 0;
+	for (v = 0; v < MAX_VOICES; v++)
+		if (p->p_owner[v] == x)
+			sampler_mix(p, v, out, n);
+	return (w + 5);
+}
+
+static void sampler_dsp(t_sampler *x, t_signal **sp)
+{
+	sampler_pool.p_fadelength = (int)(kFadeTime * 0.001f * sp[0]->s_sr);
+	if (sampler_pool.p_fadelength < 1)
+		sampler_pool.p_fadelength = 1;
+	sampler_pool.p_quietlength = (int)(kQuietTime * 0.001f * sp[0]->s_sr);
+	if (x->x_bank && x->x_bank->b_samplerate != (int)sp[0]->s_sr)
+		pd_error(x, "sampler~: %s was converted to %d Hz, \"open\" it again to convert it to %g Hz", x->x_bank->b_dir->s_name, x->x_bank->b_samplerate, sp[0]->s_sr);
+	dsp_add(sampler_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
+}
+
+static t_class *sampler_class;
+
+/* The directory <s>, relative to the patch of <x> unless it is an absolute path. */
+static t_symbol *sampler_dir(t_sampler *x, t_symbol *s)
+{
+	char dir[MAXPDSTRING];
+
+	if (sys_isabsolutepath(s->s_name))
+		snprintf(dir, sizeof(dir), "%s", s->s_name);
+	else
+		snprintf(dir, sizeof(dir), "%s/%s", canvas_getdir(x->x_canvas)->s_name, s->s_name);
+	return gensym(dir);
+}
+
+/* FWN: Makes <b> the bank of <x>. The voices that are playing finish from the old bank,
+ * which is freed after the last of them, and the next note comes from the new one.
+ */
+static void sampler_swap(t_sampler *x, t_sampler_bank *b)
+{
+	t_sampler_bank *old = x->x_bank;
+
+	x->x_bank = b;
+	if (x->x_next && !(x->x_next = sampler_find(b, x->x_next->name)))
+		pd_error(x, "sampler~: %s has no sample for \"set\", set another one", b->b_dir->s_name);
+	sampler_bank_release(old);
+}
+
+/* Takes the bank that "open" has loaded. */
+static void sampler_opened(t_sampler *x)
+{
+	t_sampler_bank *b = sampler_load_finish(x, x->x_load);
+
+	x->x_load = 0;
+	if (b)
+		sampler_swap(x, b);
+}
+
+static void sampler_tick(t_sampler *x)
+{
+	if (!atomic_load_explicit(&x->x_load->l_done, memory_order_acquire))
+	{
+		clock_delay(x->x_clock, kLoadPoll);
+		return;
+	}
+#ifndef _WIN32
+	pthread_join(x->x_loader, 0);
+#endif
+	sampler_opened(x);
+}
+
+/* FWN: "open <directory> [budget]" loads another bank in a thread while the current one
+ * goes on playing, and swaps it in when it has been loaded.
+ */
+static void sampler_open(t_sampler *x, t_symbol *s, t_floatarg budget)
+{
+	t_symbol *dir = sampler_dir(x, s);
+	t_sampler_bank *b;
+
+	if (x->x_load)
+	{
+		pd_error(x, "sampler~: open: still loading %s", x->x_load->l_bank->b_dir->s_name);
+		return;
+	}
+	if ((b = sampler_bank_find(dir)))
+	{
+		if (b != x->x_bank)
+		{
+			b->b_refcount++;
+			sampler_swap(x, b);
+		}
+		return;
+	}
+	x->x_load = sampler_load_new(dir, budget);
+#ifndef _WIN32
+	if (!pthread_create(&x->x_loader, 0, sampler_loader, x->x_load))
+	{
+		clock_delay(x->x_clock, kLoadPoll);
+		return;
+	}
+#endif
+	sampler_load_run(x->x_load);
+	sampler_opened(x);
+}
+
+static void *sampler_new(t_symbol *s, t_floatarg voices, t_floatarg budget)
+{
+	t_sampler *x = (t_sampler *)pd_new(sampler_class);
+
+	x->x_numvoices = voices < 1 ? DEFAULT_VOICES : voices > MAX_VOICES ? MAX_VOICES : (int)voices;
+	outlet_new(&x->x_ob, &s_signal);
+	x->x_canvas = canvas_getcurrent();
+	x->x_clock = clock_new(x, (t_method)sampler_tick);
+	x->x_bank = sampler_bank_get(x, sampler_dir(x, s), budget);
+
+	return (void *)x;
+}
+
+static void sampler_free(t_sampler *x)
+{
+	int v;
+
+	for (v = 0; v < MAX_VOICES; v++)
+		if (sampler_pool.p_owner[v] == x)
+			sampler_endvoice(&sampler_pool, v);
+	sampler_bank_release(x->x_bank);
+	if (x->x_load)
+	{
+#ifndef _WIN32
+		pthread_join(x->x_loader, 0);
+#endif
+		sampler_bank_release(sampler_load_finish(x, x->x_load));
+	}
+	clock_free(x->x_clock);
+}
+
+void sampler_tilde_setup(void)
+{
+	sampler_pool.p_limit = DEFAULT_POOL;
+	sampler_pool.p_steal = kStealQuietest;
+	sampler_pool.p_fadelength = (int)(kFadeTime * 44.1f); /* until sampler_dsp knows the sample rate */
+	sampler_pool.p_quietlength = (int)(kQuietTime * 44.1f);
+	sampler_reaper = clock_new(0, (t_method)sampler_reap);
+
+	sampler_class = class_new(gensym("sampler~"), (t_newmethod)sampler_new, (t_method)sampler_free, sizeof(t_sampler), 0, A_DEFSYMBOL, A_DEFFLOAT, A_DEFFLOAT, 0);
+	class_addmethod(sampler_class, (t_method)sampler_dsp, gensym("dsp"), A_CANT, 0);
+	CLASS_MAINSIGNALIN(sampler_class, t_sampler, x_f);
+	class_addmethod(sampler_class, (t_method)sampler_play, gensym("play"), A_SYMBOL, 0);
+	class_addmethod(sampler_class, (t_method)sampler_set, gensym("set"), A_SYMBOL, 0);
+	class_addmethod(sampler_class, (t_method)sampler_open, gensym("open"), A_SYMBOL, A_DEFFLOAT, 0);
+	class_addmethod(sampler_class, (t_method)sampler_stop, gensym("stop"), 0);
+	class_addmethod(sampler_class, (t_method)sampler_setpool, gensym("pool"), A_FLOAT, 0);
+	class_addmethod(sampler_class, (t_method)sampler_steal, gensym("steal"), A_SYMBOL, 0);
+}
@@ -0,0 +1,241 @@
+/* ------------------------- strum~ ------------------------------------------- */
+/*                                                                              */
+/* Strums and picks the strings with sample-accurate timing.                    */
+/* Written by Francois W. Nel for the Ukulele patch for Organelle.              */
+/*                                                                              */
+/* This program is free software: you can redistribute it and/or modify        */
+/* it under the terms of the GNU General Public License as published by        */
+/* the Free Software Foundation, either version 3 of the License, or           */
+/* (at your option) any later version.                                          */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,             */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of              */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               */
+/* GNU General Public License for more details.                                */
+/*                                                                              */
+/* You should have received a copy of the GNU General Public License           */
+/* along with this program.  If not, see <https://www.gnu.org/licenses/>.      */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#include "m_pd.h"
+
+/* Version: strum~ v0.1
+ * Every string has a signal outlet, which is 1 for the sample at which the string is
+ * plucked and 0 otherwise. Connect it to the left inlet of the sampler~ of the string,
+ * which starts the note that was set with "set <name>" at exactly that sample. The onsets
+ * of a strum are computed in samples when the strum starts, so they don't depend on the
+ * block size or on when the scheduler runs clocks, and one strum~ replaces the del chain
+ * that strummed the strings before.
+ *
+ * Usage: [strum~ <strings>], with one outlet for every string (default 4), string 1 on
+ * the left. Messages:
+ *   down        strums from the highest string to string 1
+ *   up          strums from string 1 to the highest string
+ *   downup      strums down, and up again kDownUpGap tempo steps after the down strum
+ *   pick <n>    plucks string n
+ *   tempo <ms>  time between the strings of a strum (default DEFAULT_TEMPO)
+ *   enable <n> <0|1>  a disabled string is left out of strums and picks, but keeps its
+ *               place in the timing of a strum
+ *   stop        forgets the strings that have not been plucked yet
+ *
+ * The onsets are counted from the logical time of the message, to the sample, like
+ * vline~ does, so a strum that starts between two blocks is not moved to a block start.
+ */
+
+#define DEFAULT_STRINGS 4
+#define MAX_STRINGS 16
+#define MAX_ONSETS 64 /* onsets waiting to be sent, enough for a few overlapping strums */
+
+#define DEFAULT_TEMPO 16.f /* ms */
+#define kDownUpGap 8	   /* tempo steps from the start of the down strum to the up strum */
+
+typedef struct
+{
+	double o_time; /* sample at which the string is plucked */
+	int o_string;  /* 0 for string 1 */
+} t_strum_onset;
+
+typedef struct strum
+{
+	t_object x_ob;
+
+	int x_numstrings;
+	t_sample *x_outs[MAX_STRINGS];
+	char x_enabled[MAX_STRINGS];
+
+	t_float x_tempo; /* ms */
+	t_float x_sr;
+
+	double x_time;	  /* samples computed so far, which is the start of the next block */
+	double x_reftime; /* logical time at which x_time was reached */
+	int x_blocksize;
+
+	t_strum_onset x_onsets[MAX_ONSETS];
+	int x_numonsets;
+} t_strum;
+
+static t_class *strum_class;
+
+/* FWN: The sample of the next block that the logical time of the current message falls
+ * on. Messages come in between blocks, at a logical time that is at most a block later
+ * than the end of the last block; anything else means that DSP is off.
+ */
+static double strum_now(t_strum *x)
+{
+	double elapsed = clock_gettimesince(x->x_reftime) * x->x_sr * 0.001;
+
+	if (elapsed < 0 || elapsed >= x->x_blocksize)
+		elapsed = 0;
+	return x->x_time + elapsed;
+}
+
+static void strum_add(t_strum *x, int string, double time)
+{
+	if (!x->x_enabled[string])
+		return;
+	if (x->x_numonsets == MAX_ONSETS)
+	{
+		pd_error(x, "strum~: too many strings waiting to be plucked");
+		return;
+	}
+	x->x_onsets[x->x_numonsets].o_time = time;
+	x->x_onsets[x->x_numonsets].o_string = string;
+	x->x_numonsets++;
+}
+
+/* Adds the onsets of a strum, from string <first> to string <last>, starting at <time>. */
+static void strum_strum(t_strum *x, int first, int last, double time)
+{
+	double step = x->x_tempo * x->x_sr * 0.001;
+	int direction = first <= last ? 1 : -1, s;
+
+	for (s = first;; s += direction, time += step)
+	{
+		strum_add(x, s, time);
+		if (s == last)
+			break;
+	}
+}
+
+static void strum_down(t_strum *x)
+{
+	strum_strum(x, x->x_numstrings - 1, 0, strum_now(x));
+}
+
+static void strum_up(t_strum *x)
+{
+	strum_strum(x, 0, x->x_numstrings - 1, strum_now(x));
+}
+
+static void strum_downup(t_strum *x)
+{
+	double now = strum_now(x);
+
+	strum_strum(x, x->x_numstrings - 1, 0, now);
+	strum_strum(x, 0, x->x_numstrings - 1, now + kDownUpGap * x->x_tempo * x->x_sr * 0.001);
+}
+
+static void strum_pick(t_strum *x, t_floatarg f)
+{
+	int string = (int)f - 1;
+
+	if (string < 0 || string >= x->x_numstrings)
+	{
+		pd_error(x, "strum~: pick: no string %g", f);
+		return;
+	}
+	strum_add(x, string, strum_now(x));
+}
+
+static void strum_tempo(t_strum *x, t_floatarg f)
+{
+	x->x_tempo = f < 0 ? 0 : f;
+}
+
+static void strum_enable(t_strum *x, t_floatarg string, t_floatarg on)
+{
+	if (string < 1 || string > x->x_numstrings)
+	{
+		pd_error(x, "strum~: enable: no string %g", string);
+		return;
+	}
+	x->x_enabled[(int)string - 1] = (on != 0);
+}
+
+static void strum_stop(t_strum *x)
+{
+	x->x_numonsets = 0;
+}
+
+static t_int *strum_perform(t_int *w)
+{
+	t_strum *x = (t_strum *)(w[1]);
+	int n = (int)(w[2]);
+	double end = x->x_time + n;
+	int i, s, offset;
+
+	for (s = 0; s < x->x_numstrings; s++)
+		for (i = 0; i < n; i++)
+			x->x_outs[s][i] = 0;
+
+	// FWN: Send the onsets that fall in this block. The order of the others doesn't matter.
+	for (i = 0; i < x->x_numonsets;)
+	{
+		if (x->x_onsets[i].o_time < end)
+		{
+			offset = (int)(x->x_onsets[i].o_time - x->x_time);
+			x->x_outs[x->x_onsets[i].o_string][offset < 0 ? 0 : offset] = 1;
+			x->x_onsets[i] = x->x_onsets[--x->x_numonsets];
+		}
+		else
+			i++;
+	}
+
+	x->x_time = end;
+	x->x_reftime = clock_getlogicaltime();
+	return (w + 3);
+}
+
+static void strum_dsp(t_strum *x, t_signal **sp)
+{
+	int s;
+
+	for (s = 0; s < x->x_numstrings; s++)
+		x->x_outs[s] = sp[s]->s_vec;
+	x->x_sr = sp[0]->s_sr;
+	x->x_blocksize = sp[0]->s_n;
+	dsp_add(strum_perform, 2, x, (t_int)sp[0]->s_n);
+}
+
+static void *strum_new(t_floatarg strings)
+{
+	t_strum *x = (t_strum *)pd_new(strum_class);
+	int s;
+
+	x->x_numstrings = strings < 1 ? DEFAULT_STRINGS : strings > MAX_STRINGS ? MAX_STRINGS : (int)strings;
+	for (s = 0; s < x->x_numstrings; s++)
+	{
+		outlet_new(&x->x_ob, &s_signal);
+		x->x_enabled[s] = 1;
+	}
+	x->x_tempo = DEFAULT_TEMPO;
+	x->x_sr = sys_getsr();
+	x->x_blocksize = 64;
+	x->x_reftime = clock_getlogicaltime();
+
+	return (void *)x;
+}
+
+void strum_tilde_setup(void)
+{
+	strum_class = class_new(gensym("strum~"), (t_newmethod)strum_new, 0, sizeof(t_strum), 0, A_DEFFLOAT, 0);
+	class_addmethod(strum_class, (t_method)strum_dsp, gensym("dsp"), A_CANT, 0);
+	class_addmethod(strum_class, (t_method)strum_down, gensym("down"), 0);
+	class_addmethod(strum_class, (t_method)strum_up, gensym("up"), 0);
+	class_addmethod(strum_class, (t_method)strum_downup, gensym("downup"), 0);
+	class_addmethod(strum_class, (t_method)strum_pick, gensym("pick"), A_FLOAT, 0);
+	class_addmethod(strum_class, (t_method)strum_tempo, gensym("tempo"), A_FLOAT, 0);
+	class_addmethod(strum_class, (t_method)strum_enable, gensym("enable"), A_FLOAT, A_FLOAT, 0);
+	class_addmethod(strum_class, (t_method)strum_stop, gensym("stop"), 0);
+}
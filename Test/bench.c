@@ -0,0 +1,298 @@
+/* ------------------------- bench -------------------------------------------- */
+/*                                                                              */
+/* Measures how long notchord takes per note message, outside of Pd.            */
+/* Built and run by "make bench".                                               */
+/*                                                                              */
+/* Usage: bench [-r repeats] [-m table|template] [recording ...]               */
+/*                                                                              */
+/* A recording is a text file with one note per line: "<delta> <pitch> <velo>", */
+/* where delta is the time in ms since the previous note. Notes with a delta of */
+/* 0 arrive at the same logical time, like the notes of a chord from [notein].  */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#include "notchord.c"
+
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct
+{
+	float delta; /* ms since the previous event */
+	short pitch;
+	short velo;
+} t_bench_event;
+
+typedef struct
+{
+	const char *name;
+	t_bench_event *events;
+	int numevents;
+	int allocated;
+} t_bench_stream;
+
+static unsigned int bench_seed = 1;
+
+/* Deterministic, so that runs are comparable. */
+static int bench_random(int range)
+{
+	bench_seed ^= bench_seed << 13;
+	bench_seed ^= bench_seed >> 17;
+	bench_seed ^= bench_seed << 5;
+	return (int)(bench_seed % (unsigned int)range);
+}
+
+static void bench_add(t_bench_stream *stream, float delta, int pitch, int velo)
+{
+	if (stream->numevents == stream->allocated)
+	{
+		stream->allocated = stream->allocated ? 2 * stream->allocated : 1024;
+		stream->events = (t_bench_event *)realloc(stream->events, stream->allocated * sizeof(t_bench_event));
+	}
+	stream->events[stream->numevents].delta = delta;
+	stream->events[stream->numevents].pitch = (short)pitch;
+	stream->events[stream->numevents].velo = (short)velo;
+	stream->numevents++;
+}
+
+/* One note at a time, with rests in between. */
+static void bench_melody(t_bench_stream *stream)
+{
+	int i, pitch;
+
+	stream->name = "melody";
+	for (i = 0; i < 2000; i++)
+	{
+		pitch = 48 + bench_random(36);
+		bench_add(stream, 100, pitch, 100);
+		bench_add(stream, 150, pitch, 0);
+	}
+}
+
+/* Clusters of 6 to 11 notes that are struck and released together. */
+static void bench_clusters(t_bench_stream *stream)
+{
+	int i, j, n, pitches[11];
+
+	stream->name = "clusters";
+	for (i = 0; i < 500; i++)
+	{
+		n = 6 + bench_random(6);
+		for (j = 0; j < n; j++)
+		{
+			int k;
+			do
+			{
+				pitches[j] = 48 + bench_random(24);
+				for (k = 0; k < j && pitches[k] != pitches[j]; k++)
+					;
+			} while (k < j); /* every note only once */
+			bench_add(stream, j ? 0 : 200, pitches[j], 100);
+		}
+		for (j = 0; j < n; j++)
+			bench_add(stream, j ? 0 : 500, pitches[j], 0);
+	}
+}
+
+/* Fast overlapping lines: every note starts before the previous one ends. */
+static void bench_legato(t_bench_stream *stream)
+{
+	int i, pitch, last = 60, previous = 64;
+
+	stream->name = "legato";
+	bench_add(stream, 0, previous, 100);
+	bench_add(stream, 0, last, 100);
+	for (i = 0; i < 4000; i++)
+	{
+		pitch = last + bench_random(9) - 4;
+		if (pitch == last || pitch == previous || pitch < 36 || pitch > 96)
+			pitch = last + 5;
+		if (pitch > 96)
+			pitch = 40;
+		bench_add(stream, 5 + bench_random(20), pitch, 100);
+		bench_add(stream, 0, previous, 0);
+		previous = last;
+		last = pitch;
+	}
+	bench_add(stream, 50, previous, 0);
+	bench_add(stream, 0, last, 0);
+}
+
+static int bench_read(t_bench_stream *stream, const char *path)
+{
+	FILE *fd = fopen(path, "r");
+	float delta;
+	int pitch, velo, line = 0;
+	char buf[256];
+
+	if (!fd)
+	{
+		fprintf(stderr, "bench: %s: can't open\n", path);
+		return 0;
+	}
+	stream->name = path;
+	while (fgets(buf, sizeof(buf), fd))
+	{
+		line++;
+		if (*buf == '#' || *buf == '\n' || *buf == '\r')
+			continue;
+		if (sscanf(buf, "%f %d %d", &delta, &pitch, &velo) != 3)
+		{
+			fprintf(stderr, "bench: %s:%d: expected \"<delta> <pitch> <velo>\"\n", path, line);
+			fclose(fd);
+			return 0;
+		}
+		bench_add(stream, delta, pitch, velo);
+	}
+	fclose(fd);
+	return 1;
+}
+
+static double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+	double d = *(const double *)a - *(const double *)b;
+	return (d > 0) - (d < 0);
+}
+
+/* Plays a stream through a notchord. With a coalescing time of -1 every note message is
+ * timed on its own; otherwise all messages at one logical time are timed together with
+ * the detection that follows them. Returns the number of samples.
+ */
+static int bench_play(t_chord *x, t_bench_stream *stream, double *samples)
+{
+	int i = 0, n = 0;
+	double start;
+
+	while (i < stream->numevents)
+	{
+		pdstub_advance(stream->events[i].delta);
+		if (x->x_coalesce < 0)
+		{
+			start = bench_now();
+			chord_ft1(x, stream->events[i].velo);
+			chord_float(x, stream->events[i].pitch);
+			samples[n++] = bench_now() - start;
+			i++;
+		}
+		else
+		{
+			start = bench_now();
+			do
+			{
+				chord_ft1(x, stream->events[i].velo);
+				chord_float(x, stream->events[i].pitch);
+				i++;
+			} while (i < stream->numevents && stream->events[i].delta == 0);
+			pdstub_advance(0);
+			samples[n++] = bench_now() - start;
+		}
+	}
+	pdstub_advance(1000); /* let the hold time run out */
+	return n;
+}
+
+static void bench_report(const char *name, const char *unit, double *samples, int n)
+{
+	double sum = 0;
+	int i;
+
+	qsort(samples, n, sizeof(double), bench_compare);
+	for (i = 0; i < n; i++)
+		sum += samples[i];
+	printf("%-12s %-5s %8d %8.0f %8.0f %8.0f %8.0f %8.0f %8.0f\n", name, unit, n, sum / n,
+		   samples[n / 2], samples[(int)(n * 0.9)], samples[(int)(n * 0.99)], samples[(int)(n * 0.999)], samples[n - 1]);
+}
+
+static void bench_run(t_chord *x, t_bench_stream *stream, int repeats)
+{
+	double *samples = (double *)malloc((size_t)stream->numevents * repeats * sizeof(double));
+	int r, n;
+
+	if (!stream->numevents)
+		return;
+
+	x->x_coalesce = -1;
+	bench_play(x, stream, samples); /* warm up the caches */
+	for (r = 0, n = 0; r < repeats; r++)
+		n += bench_play(x, stream, samples + n);
+	bench_report(stream->name, "note", samples, n);
+
+	x->x_coalesce = 0;
+	for (r = 0, n = 0; r < repeats; r++)
+		n += bench_play(x, stream, samples + n);
+	bench_report(stream->name, "tick", samples, n);
+
+	free(samples);
+}
+
+int main(int argc, char **argv)
+{
+	t_bench_stream streams[3] = {{0}}, recording;
+	int repeats = 20, i;
+	const char *mode = "table";
+	double start, overhead = 1e9;
+	t_chord *x;
+
+	while (argc > 2 && argv[1][0] == '-')
+	{
+		if (!strcmp(argv[1], "-r"))
+			repeats = atoi(argv[2]);
+		else if (!strcmp(argv[1], "-m"))
+			mode = argv[2];
+		else
+		{
+			fprintf(stderr, "usage: bench [-r repeats] [-m table|template] [recording ...]\n");
+			return 2;
+		}
+		argc -= 2, argv += 2;
+	}
+	if (repeats < 1)
+		repeats = 1;
+
+	start = bench_now();
+	notchord_setup();
+	printf("setup: %.0f us\n", (bench_now() - start) / 1000);
+
+	x = (t_chord *)chord_new(0, 0);
+	x->x_defaultchord = gensym("A minor 7th");
+	chord_mode(x, gensym(mode));
+	pdstub_quiet = 1; /* recordings may have stray note-offs */
+
+	for (i = 0; i < 1000; i++)
+	{
+		start = bench_now();
+		start = bench_now() - start;
+		if (start < overhead)
+			overhead = start;
+	}
+	printf("mode: %s\ntimer overhead: %.0f ns (included below)\n\n", mode, overhead);
+	printf("%-12s %-5s %8s %8s %8s %8s %8s %8s %8s\n", "stream", "per", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+
+	bench_melody(&streams[0]);
+	bench_clusters(&streams[1]);
+	bench_legato(&streams[2]);
+	for (i = 0; i < 3; i++)
+	{
+		bench_run(x, &streams[i], repeats);
+		free(streams[i].events);
+	}
+	for (i = 1; i < argc; i++)
+	{
+		memset(&recording, 0, sizeof(recording));
+		if (bench_read(&recording, argv[i]))
+			bench_run(x, &recording, repeats);
+		free(recording.events);
+	}
+	printf("\nall times in ns\n");
+
+	chord_free(x);
+	pd_free((t_pd *)x);
+	return 0;
+}
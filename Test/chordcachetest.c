@@ -0,0 +1,108 @@
+/* ------------------------- chordcachetest ----------------------------------- */
+/*                                                                              */
+/* Loads Ukulele/Chords into chordcache and asks it for known and unknown       */
+/* chords, checking the notes and the found outlet. Built and run by            */
+/* "make check", from the top directory.                                        */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#include "chordcache.c"
+
+#define CHORDS "Ukulele/Chords"
+
+typedef struct
+{
+	const char *t_name; /* that is asked for */
+	int t_found;		/* whether it should be found */
+	const char *t_file; /* chord whose notes should come out, or NULL for none */
+} t_chordcachetest;
+
+static const t_chordcachetest chordcachetests[] = {
+	{"X minor", 0, 0}, /* no chord has been found yet */
+	{"C major", 1, "C major"},
+	{"A minor", 1, "A minor"},
+	{"X minor", 0, "A minor"}, /* the last chord that was found */
+	{"C major", 1, "C major"},
+};
+
+static t_chordcache *chordcachetest_cache;
+static t_atom chordcachetest_notes[MAX_NOTES];
+static int chordcachetest_numnotes;
+static int chordcachetest_found;
+
+static void chordcachetest_outlet(t_object *owner, int outlet, t_symbol *s, int argc, t_atom *argv)
+{
+	if (owner != &chordcachetest_cache->x_ob)
+		return;
+	if (outlet == 0 && s == &s_list && argc <= MAX_NOTES)
+	{
+		chordcachetest_numnotes = argc;
+		memcpy(chordcachetest_notes, argv, argc * sizeof(t_atom));
+	}
+	else if (outlet == 1)
+		chordcachetest_found = (int)atom_getfloat(argv);
+}
+
+/* Asks for a chord and returns the number of problems. */
+static int chordcachetest_ask(const t_chordcachetest *t)
+{
+	char path[MAXPDSTRING], note[MAXPDSTRING];
+	FILE *fd;
+	int i, problems = 0;
+
+	chordcachetest_numnotes = 0;
+	chordcachetest_found = -1;
+	chordcache_symbol(chordcachetest_cache, gensym(t->t_name));
+
+	printf("chordcachetest: %s -> %d:", t->t_name, chordcachetest_found);
+	for (i = 0; i < chordcachetest_numnotes; i++)
+		printf(" %s", atom_getsymbol(chordcachetest_notes + i)->s_name);
+	printf("\n");
+
+	if (chordcachetest_found != t->t_found)
+		problems++, fprintf(stderr, "chordcachetest: %s: found is not %d\n", t->t_name, t->t_found);
+	if (!t->t_file)
+	{
+		if (chordcachetest_numnotes)
+			problems++, fprintf(stderr, "chordcachetest: %s: notes came out\n", t->t_name);
+		return problems;
+	}
+
+	/* the notes should be the ones in the file, in its order */
+	snprintf(path, sizeof(path), "%s/%s.txt", CHORDS, t->t_file);
+	if (!(fd = fopen(path, "r")))
+	{
+		fprintf(stderr, "chordcachetest: %s: can't open\n", path);
+		return problems + 1;
+	}
+	for (i = 0; fscanf(fd, "%999s", note) == 1; i++)
+		if (i >= chordcachetest_numnotes || atom_getsymbol(chordcachetest_notes + i) != gensym(note))
+			break;
+	if (!feof(fd) || i != chordcachetest_numnotes)
+		problems++, fprintf(stderr, "chordcachetest: %s: the notes are not those of %s\n", t->t_name, path);
+	fclose(fd);
+	return problems;
+}
+
+int main(void)
+{
+	int t, numchords, problems = 0;
+
+	chordcache_setup();
+	chordcachetest_cache = (t_chordcache *)chordcache_new(gensym(CHORDS));
+	pdstub_outlethook = chordcachetest_outlet;
+	if (!(numchords = chordcachetest_cache->x_numchords))
+		problems++, fprintf(stderr, "chordcachetest: no chords were loaded from %s\n", CHORDS);
+
+	for (t = 0; t < (int)(sizeof(chordcachetests) / sizeof(chordcachetests[0])); t++)
+		problems += chordcachetest_ask(&chordcachetests[t]);
+
+	chordcache_free(chordcachetest_cache);
+	if (problems)
+	{
+		fprintf(stderr, "chordcachetest: FAILED\n");
+		return 1;
+	}
+	printf("chordcachetest: %d chords loaded, hits and misses answered\n", numchords);
+	return 0;
+}
@@ -0,0 +1,151 @@
+/* ------------------------- chromatest --------------------------------------- */
+/*                                                                              */
+/* Plays triads with each of their notes in the bass into chroma~, and checks   */
+/* the notes that it sends, the chord that the [notchord 48 71] of main-next.pd */
+/* names from them, and the inversion that a notchord in template mode finds.   */
+/* Built and run by "make check".                                               */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#include "chroma~.c"
+#include "notchord.c"
+
+#define BLOCKSIZE 64
+#define SECONDS 1 /* of every chord, enough for a few analyses of DEFAULT_SIZE */
+#define HARMONICS 4
+
+typedef struct
+{
+	const char *t_name; /* that notchord should find */
+	int t_notes[3];		/* pitch classes, root first */
+} t_chromatest_triad;
+
+static const t_chromatest_triad chromatest_triads[] = {
+	{"C major", {0, 4, 7}},
+	{"A minor", {9, 0, 4}},
+};
+
+static t_chroma *chromatest_chroma;
+static t_chord *chromatest_chord;
+static t_chord *chromatest_template; /* that finds the inversion from the bass */
+static t_atom chromatest_notes[12];
+static int chromatest_numnotes;
+static t_symbol *chromatest_name;
+
+/* Remembers the last chord of chroma~ and passes it on to notchord, like the patch would. */
+static void chromatest_outlet(t_object *owner, int outlet, t_symbol *s, int argc, t_atom *argv)
+{
+	if (owner == &chromatest_chroma->x_ob && outlet == 0 && s == gensym("chord"))
+	{
+		chromatest_numnotes = argc;
+		memcpy(chromatest_notes, argv, argc * sizeof(t_atom));
+		chord_chord(chromatest_chord, s, argc, argv);
+		chord_chord(chromatest_template, s, argc, argv);
+	}
+	else if (owner == &chromatest_chord->x_ob && outlet == 0 && s == &s_symbol)
+		chromatest_name = atom_getsymbol(argv);
+}
+
+/* Plays note <bass> of the triad in the highest octave below kBassFreq and the others in
+ * the octave of C4, and returns the number of problems. The FFT can't tell the semitones of
+ * the octave of C2 apart, so the bass is kept above it.
+ */
+static int chromatest_play(const t_chromatest_triad *t, int bass)
+{
+	t_sample in[BLOCKSIZE];
+	double freqs[3], phase[3] = {0};
+	int i, j, k, b, pc, sent = 0, problems = 0;
+
+	for (i = 0; i < 3; i++)
+	{
+		pc = t->t_notes[(bass + i) % 3];
+		freqs[i] = 440 * pow(2, ((i ? kNote : kBassNote) + pc - 69) / 12.0);
+	}
+	while (freqs[0] >= kBassFreq)
+		freqs[0] /= 2;
+	chromatest_numnotes = 0;
+	chromatest_name = 0;
+	for (b = 0; b < SECONDS * 44100 / BLOCKSIZE; b++)
+	{
+		for (j = 0; j < BLOCKSIZE; j++)
+		{
+			in[j] = 0;
+			for (i = 0; i < 3; i++)
+			{
+				for (k = 1; k <= HARMONICS; k++)
+					in[j] += 0.2f / k * (t_sample)sin(k * phase[i]);
+				phase[i] += 2 * M_PI * freqs[i] / 44100;
+			}
+		}
+		chroma_perform((t_int[]){0, (t_int)chromatest_chroma, (t_int)in, BLOCKSIZE});
+		pdstub_advance(1000. * BLOCKSIZE / 44100);
+	}
+
+	printf("chromatest: %s, %d in the bass:", t->t_name, t->t_notes[bass]);
+	for (i = 0; i < chromatest_numnotes; i++)
+		printf(" %g", atom_getfloat(chromatest_notes + i));
+	printf(" -> %s, inversion %d\n", chromatest_name ? chromatest_name->s_name : "-", chromatest_template->x_chord_inversion);
+
+	if (!chromatest_numnotes || atom_getfloat(chromatest_notes) != kBassNote + t->t_notes[bass])
+		problems++, fprintf(stderr, "chromatest: the bass is not %d\n", kBassNote + t->t_notes[bass]);
+	for (i = 0; i < 3; i++)
+		for (j = 1; j < chromatest_numnotes; j++)
+			if (atom_getfloat(chromatest_notes + j) == kNote + t->t_notes[i])
+			{
+				sent |= 1 << i;
+				break;
+			}
+	if (sent != (7 & ~(1 << bass)) || chromatest_numnotes != 3)
+		problems++, fprintf(stderr, "chromatest: the upper notes are not the other 2 of the triad\n");
+	if (chromatest_chord->x_chord_bass != kBassNote + t->t_notes[bass])
+		problems++, fprintf(stderr, "chromatest: notchord did not take %d as the bass\n", kBassNote + t->t_notes[bass]);
+	if (!chromatest_name || strcmp(chromatest_name->s_name, t->t_name))
+		problems++, fprintf(stderr, "chromatest: notchord did not find %s\n", t->t_name);
+	if (chromatest_template->x_chord_root != t->t_notes[0] || chromatest_template->x_chord_inversion != bass)
+		problems++, fprintf(stderr, "chromatest: the template did not find inversion %d of %s\n", bass, t->t_name);
+
+	/* silence, so that the next triad starts from nothing */
+	for (j = 0; j < BLOCKSIZE; j++)
+		in[j] = 0;
+	for (b = 0; b < SECONDS * 44100 / BLOCKSIZE; b++)
+	{
+		chroma_perform((t_int[]){0, (t_int)chromatest_chroma, (t_int)in, BLOCKSIZE});
+		pdstub_advance(1000. * BLOCKSIZE / 44100);
+	}
+	return problems;
+}
+
+int main(void)
+{
+	t_signal signal = {0}, *sp[1] = {&signal};
+	t_sample dummy[BLOCKSIZE];
+	int t, bass, problems = 0;
+
+	chroma_tilde_setup();
+	notchord_setup();
+	chromatest_chroma = (t_chroma *)chroma_new(0, 0);
+	chromatest_chord = (t_chord *)chord_new(48, 71);
+	chromatest_template = (t_chord *)chord_new(48, 71);
+	chord_mode(chromatest_template, gensym("template"));
+	pdstub_outlethook = chromatest_outlet;
+
+	signal.s_n = BLOCKSIZE;
+	signal.s_vec = dummy;
+	signal.s_sr = 44100;
+	chroma_dsp(chromatest_chroma, sp);
+
+	for (t = 0; t < (int)(sizeof(chromatest_triads) / sizeof(chromatest_triads[0])); t++)
+		for (bass = 0; bass < 3; bass++)
+			problems += chromatest_play(&chromatest_triads[t], bass);
+
+	chroma_free(chromatest_chroma);
+	chord_free(chromatest_chord);
+	chord_free(chromatest_template);
+	if (problems)
+	{
+		fprintf(stderr, "chromatest: FAILED\n");
+		return 1;
+	}
+	printf("chromatest: every triad was named with each of its notes in the bass\n");
+	return 0;
+}
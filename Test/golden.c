@@ -0,0 +1,140 @@
+/* ------------------------- golden ------------------------------------------- */
+/*                                                                              */
+/* Feeds every pitch class set, with every one of its pitch classes in the      */
+/* bass, through notchord and compares the result with a golden file.           */
+/* Built and run by "make check"; "make golden" rewrites the golden file.       */
+/*                                                                              */
+/* Usage: golden [-w] <golden file>                                             */
+/*                                                                              */
+/* Every line of the golden file is "<set> <bass> <type> <root> <inversion>     */
+/* <chord>", tab separated. The set is the 12-bit pitch class mask in hex, the  */
+/* bass is a pitch class and <chord> is the symbol sent out of the left outlet, */
+/* or "-" if there was none.                                                    */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#include "notchord.c"
+
+#include <stdlib.h>
+#include <time.h>
+
+#define GOLDEN_BASS 48	/* the bass note is in the octave below the others */
+#define GOLDEN_UPPER 60 /* octave of the other notes */
+#define MAX_REPORTED 20 /* number of differences that are printed */
+#define GOLDEN_SETS 4096 /* 12-bit pitch class sets */
+
+static t_symbol *golden_chord; /* symbol sent out of the left outlet, if any */
+
+static void golden_outlet(t_object *owner, int outlet, t_symbol *s, int argc, t_atom *argv)
+{
+	(void)owner;
+	if (outlet == 0 && s == &s_symbol && argc == 1)
+		golden_chord = atom_getsymbol(argv);
+}
+
+static void golden_notes(t_chord *x, int set, int bass, int velo)
+{
+	int pc;
+
+	chord_ft1(x, velo);
+	chord_float(x, GOLDEN_BASS + bass);
+	for (pc = 0; pc < 12; pc++)
+		if (pc != bass && (set & (1 << pc)))
+			chord_float(x, GOLDEN_UPPER + pc);
+}
+
+/* Plays one chord and writes its line of the golden file into buf. */
+static void golden_play(t_chord *x, int set, int bass, char *buf, size_t size)
+{
+	golden_chord = 0;
+	golden_notes(x, set, bass, 100);
+	pdstub_advance(0);
+	snprintf(buf, size, "%03x\t%d\t%d\t%d\t%d\t%s\n", set, bass, (int)x->x_chord_type, (int)x->x_chord_root,
+			 (int)x->x_chord_inversion, golden_chord ? golden_chord->s_name : "-");
+
+	golden_notes(x, set, bass, 0);
+	pdstub_advance(1000);
+}
+
+static double golden_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+	char line[MAXPDSTRING], expected[MAXPDSTRING];
+	int write = 0, set, bass, lines = 0, differences = 0;
+	double start, sweep;
+	t_chord *x;
+	FILE *fd;
+
+	if (argc > 1 && !strcmp(argv[1], "-w"))
+		write = 1, argc--, argv++;
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: golden [-w] <golden file>\n");
+		return 2;
+	}
+	if (!(fd = fopen(argv[1], write ? "w" : "r")))
+	{
+		fprintf(stderr, "golden: %s: can't open\n", argv[1]);
+		return 2;
+	}
+
+	notchord_setup();
+	x = (t_chord *)chord_new(0, 0);
+	x->x_defaultchord = gensym("A minor 7th");
+	pdstub_outlethook = golden_outlet;
+
+	start = golden_now();
+	for (set = 1; set < GOLDEN_SETS; set++)
+		for (bass = 0; bass < 12; bass++)
+		{
+			if (!(set & (1 << bass)))
+				continue;
+			golden_play(x, set, bass, line, sizeof(line));
+			lines++;
+
+			if (write)
+				fputs(line, fd);
+			else if (!fgets(expected, sizeof(expected), fd))
+			{
+				fprintf(stderr, "golden: %s ends after %d lines\n", argv[1], lines - 1);
+				differences = -1;
+				goto done;
+			}
+			else if (strcmp(line, expected))
+			{
+				if (++differences <= MAX_REPORTED)
+					fprintf(stderr, "- %s+ %s", expected, line);
+			}
+		}
+	if (!write && fgets(expected, sizeof(expected), fd))
+	{
+		fprintf(stderr, "golden: %s has more than %d lines\n", argv[1], lines);
+		differences = -1;
+	}
+
+done:
+	sweep = golden_now() - start;
+	fclose(fd);
+	chord_free(x);
+	pd_free((t_pd *)x);
+
+	if (write)
+		printf("golden: wrote %d chords to %s\n", lines, argv[1]);
+	else if (differences)
+	{
+		if (differences > MAX_REPORTED)
+			fprintf(stderr, "... %d more\n", differences - MAX_REPORTED);
+		fprintf(stderr, "golden: FAILED, output differs from %s\n", argv[1]);
+		return 1;
+	}
+	else
+		printf("golden: %d chords match %s\n", lines, argv[1]);
+	printf("golden: sweep took %.1f ms (%.0f ns per chord)\n", sweep / 1e6, sweep / lines);
+	return 0;
+}
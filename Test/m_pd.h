@@ -0,0 +1,193 @@
+/* ------------------------- m_pd.h (stub) ------------------------------------ */
+/*                                                                              */
+/* The part of the Pd API used by the externals in Source, so that they can be  */
+/* compiled into the test and benchmark programs without Pd. See pdstub.c.      */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#ifndef __m_pd_h_
+#define __m_pd_h_
+
+#include <stddef.h>
+
+#define PD_MAJOR_VERSION 0
+#define PD_MINOR_VERSION 51
+
+#define EXTERN extern
+#define MAXPDSTRING 1000
+
+typedef long t_int;
+typedef float t_float;
+typedef float t_floatarg;
+typedef float t_sample;
+
+struct _class;
+struct _outlet;
+struct _inlet;
+struct _clock;
+struct _glist;
+
+typedef struct _class *t_pd;
+typedef struct _class t_class;
+typedef struct _outlet t_outlet;
+typedef struct _inlet t_inlet;
+typedef struct _clock t_clock;
+typedef struct _glist t_canvas;
+
+typedef struct _symbol
+{
+	const char *s_name;
+	t_pd *s_thing;
+	struct _symbol *s_next;
+} t_symbol;
+
+typedef struct _gobj
+{
+	t_pd g_pd;
+	struct _gobj *g_next;
+} t_gobj;
+
+typedef struct _text
+{
+	t_gobj te_g;
+	void *te_binbuf;
+	t_outlet *te_outlet;
+	t_inlet *te_inlet;
+	short te_xpix, te_ypix, te_width;
+	unsigned int te_type : 2;
+} t_object;
+
+#define ob_pd te_g.g_pd
+
+typedef enum
+{
+	A_NULL,
+	A_FLOAT,
+	A_SYMBOL,
+	A_POINTER,
+	A_SEMI,
+	A_COMMA,
+	A_DEFFLOAT,
+	A_DEFSYM,
+	A_DOLLAR,
+	A_DOLLSYM,
+	A_GIMME,
+	A_CANT
+} t_atomtype;
+
+#define A_DEFSYMBOL A_DEFSYM
+
+union word
+{
+	t_float w_float;
+	t_symbol *w_symbol;
+	int w_index;
+};
+
+typedef struct _atom
+{
+	t_atomtype a_type;
+	union word a_w;
+} t_atom;
+
+typedef void (*t_method)(void);
+typedef void *(*t_newmethod)(void);
+typedef t_int *(*t_perfroutine)(t_int *args);
+
+typedef struct _signal
+{
+	int s_n;		  /* number of samples */
+	t_sample *s_vec;  /* the samples */
+	t_float s_sr;	  /* sample rate */
+} t_signal;
+
+#define SETFLOAT(atom, f) ((atom)->a_type = A_FLOAT, (atom)->a_w.w_float = (f))
+#define SETSYMBOL(atom, s) ((atom)->a_type = A_SYMBOL, (atom)->a_w.w_symbol = (s))
+
+#define CLASS_DEFAULT 0
+
+EXTERN t_symbol s_float, s_symbol, s_list, s_bang, s_signal, s_anything, s_;
+
+EXTERN t_symbol *gensym(const char *s);
+
+EXTERN void post(const char *fmt, ...);
+EXTERN void pd_error(void *object, const char *fmt, ...);
+EXTERN void logpost(const void *object, int level, const char *fmt, ...);
+
+EXTERN void *getbytes(size_t nbytes);
+EXTERN void *resizebytes(void *x, size_t oldsize, size_t newsize);
+EXTERN void freebytes(void *x, size_t nbytes);
+
+EXTERN t_pd *pd_new(t_class *cls);
+EXTERN void pd_free(t_pd *x);
+
+EXTERN t_inlet *inlet_new(t_object *owner, t_pd *dest, t_symbol *s1, t_symbol *s2);
+EXTERN t_inlet *symbolinlet_new(t_object *owner, t_symbol **sp);
+EXTERN t_inlet *floatinlet_new(t_object *owner, t_float *fp);
+
+EXTERN t_outlet *outlet_new(t_object *owner, t_symbol *s);
+EXTERN void outlet_bang(t_outlet *x);
+EXTERN void outlet_float(t_outlet *x, t_float f);
+EXTERN void outlet_symbol(t_outlet *x, t_symbol *s);
+EXTERN void outlet_list(t_outlet *x, t_symbol *s, int argc, t_atom *argv);
+EXTERN void outlet_anything(t_outlet *x, t_symbol *s, int argc, t_atom *argv);
+
+EXTERN t_class *class_new(t_symbol *name, t_newmethod newmethod, t_method freemethod, size_t size, int flags, t_atomtype arg1, ...);
+EXTERN void class_addmethod(t_class *c, t_method fn, t_symbol *sel, t_atomtype arg1, ...);
+EXTERN void class_addbang(t_class *c, t_method fn);
+EXTERN void class_addfloat(t_class *c, t_method fn);
+EXTERN void class_addsymbol(t_class *c, t_method fn);
+EXTERN void class_addlist(t_class *c, t_method fn);
+EXTERN void class_addanything(t_class *c, t_method fn);
+EXTERN void class_domainsignalin(t_class *c, int onset);
+#define CLASS_MAINSIGNALIN(c, type, field) class_domainsignalin(c, (int)offsetof(type, field))
+
+#ifndef PDSTUB
+#define class_addbang(x, y) class_addbang((x), (t_method)(y))
+#define class_addfloat(x, y) class_addfloat((x), (t_method)(y))
+#define class_addsymbol(x, y) class_addsymbol((x), (t_method)(y))
+#define class_addlist(x, y) class_addlist((x), (t_method)(y))
+#define class_addanything(x, y) class_addanything((x), (t_method)(y))
+#endif
+
+EXTERN t_clock *clock_new(void *owner, t_method fn);
+EXTERN void clock_set(t_clock *x, double systime);
+EXTERN void clock_delay(t_clock *x, double delaytime);
+EXTERN void clock_unset(t_clock *x);
+EXTERN void clock_free(t_clock *x);
+EXTERN double clock_getlogicaltime(void);
+EXTERN double clock_gettimesince(double prevsystime);
+
+EXTERN t_float atom_getfloat(const t_atom *a);
+EXTERN t_symbol *atom_getsymbol(const t_atom *a);
+EXTERN t_float atom_getfloatarg(int which, int argc, const t_atom *argv);
+EXTERN t_symbol *atom_getsymbolarg(int which, int argc, const t_atom *argv);
+
+EXTERN void dsp_add(t_perfroutine f, int n, ...);
+EXTERN t_float sys_getsr(void);
+
+EXTERN t_canvas *canvas_getcurrent(void);
+EXTERN t_symbol *canvas_getdir(const t_canvas *x);
+EXTERN int sys_isabsolutepath(const char *dir);
+
+/* Not part of Pd: drives the stub from the test programs. */
+
+/* Called for everything an object sends out of an outlet. The outlets of an object are
+   numbered from 0 in the order in which they were created. */
+typedef void (*t_pdstub_outlethook)(t_object *owner, int outlet, t_symbol *s, int argc, t_atom *argv);
+EXTERN t_pdstub_outlethook pdstub_outlethook;
+
+/* Advances logical time by the given number of ms, running all clocks that are due. A
+   delay of 0 runs the clocks that were set for the current logical time. */
+EXTERN void pdstub_advance(double ms);
+
+/* Runs the DSP routines added with dsp_add() once, in the order in which they were added. */
+EXTERN void pdstub_dsptick(void);
+
+/* Forgets the DSP routines, like Pd does before it sorts the DSP chain again. */
+EXTERN void pdstub_dspreset(void);
+
+/* Suppresses post() and pd_error() when set. */
+EXTERN int pdstub_quiet;
+
+#endif /* __m_pd_h_ */
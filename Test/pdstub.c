@@ -0,0 +1,394 @@
+/* ------------------------- pdstub ------------------------------------------- */
+/*                                                                              */
+/* A minimal stand-in for Pd, so that the externals in Source can be driven by  */
+/* the test and benchmark programs. Messages are sent by calling the methods    */
+/* directly; clocks run in logical time when pdstub_advance() is called.        */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#define PDSTUB
+#include "m_pd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+t_symbol s_float = {"float", 0, 0};
+t_symbol s_symbol = {"symbol", 0, 0};
+t_symbol s_list = {"list", 0, 0};
+t_symbol s_bang = {"bang", 0, 0};
+t_symbol s_signal = {"signal", 0, 0};
+t_symbol s_anything = {"anything", 0, 0};
+t_symbol s_ = {"", 0, 0};
+
+t_pdstub_outlethook pdstub_outlethook;
+int pdstub_quiet;
+
+/* ---------------------------- symbols ---------------------------------------- */
+
+#define SYMTABSIZE 4096
+
+static t_symbol *pdstub_symtab[SYMTABSIZE];
+
+t_symbol *gensym(const char *s)
+{
+	unsigned int hash = 5381;
+	const char *c;
+	t_symbol *sym;
+
+	for (c = s; *c; c++)
+		hash = hash * 33 + (unsigned char)*c;
+	hash &= SYMTABSIZE - 1;
+	for (sym = pdstub_symtab[hash]; sym; sym = sym->s_next)
+		if (!strcmp(sym->s_name, s))
+			return sym;
+
+	sym = (t_symbol *)calloc(1, sizeof(t_symbol));
+	sym->s_name = strdup(s);
+	sym->s_next = pdstub_symtab[hash];
+	pdstub_symtab[hash] = sym;
+	return sym;
+}
+
+/* ---------------------------- printing --------------------------------------- */
+
+static void pdstub_vprint(const char *fmt, va_list ap)
+{
+	if (pdstub_quiet)
+		return;
+	vfprintf(stderr, fmt, ap);
+	fputc('\n', stderr);
+}
+
+void post(const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	pdstub_vprint(fmt, ap);
+	va_end(ap);
+}
+
+void pd_error(void *object, const char *fmt, ...)
+{
+	va_list ap;
+	(void)object;
+	va_start(ap, fmt);
+	pdstub_vprint(fmt, ap);
+	va_end(ap);
+}
+
+void logpost(const void *object, int level, const char *fmt, ...)
+{
+	va_list ap;
+	(void)object;
+	if (level > 2) /* Pd hides these unless it is verbose */
+		return;
+	va_start(ap, fmt);
+	pdstub_vprint(fmt, ap);
+	va_end(ap);
+}
+
+/* ---------------------------- memory ----------------------------------------- */
+
+void *getbytes(size_t nbytes)
+{
+	return calloc(1, nbytes ? nbytes : 1);
+}
+
+void *resizebytes(void *x, size_t oldsize, size_t newsize)
+{
+	char *y = (char *)realloc(x, newsize ? newsize : 1);
+	if (newsize > oldsize)
+		memset(y + oldsize, 0, newsize - oldsize);
+	return y;
+}
+
+void freebytes(void *x, size_t nbytes)
+{
+	(void)nbytes;
+	free(x);
+}
+
+/* ---------------------------- objects ---------------------------------------- */
+
+struct _class
+{
+	t_symbol *c_name;
+	size_t c_size;
+};
+
+struct _outlet
+{
+	t_object *o_owner;
+	int o_index;
+	struct _outlet *o_next;
+};
+
+struct _inlet
+{
+	int i_unused;
+};
+
+t_class *class_new(t_symbol *name, t_newmethod newmethod, t_method freemethod, size_t size, int flags, t_atomtype arg1, ...)
+{
+	t_class *c = (t_class *)calloc(1, sizeof(t_class));
+	(void)newmethod, (void)freemethod, (void)flags, (void)arg1;
+	c->c_name = name;
+	c->c_size = size;
+	return c;
+}
+
+/* Methods are called directly by the test programs, so they need not be registered. */
+void class_addmethod(t_class *c, t_method fn, t_symbol *sel, t_atomtype arg1, ...) { (void)c, (void)fn, (void)sel, (void)arg1; }
+void class_addbang(t_class *c, t_method fn) { (void)c, (void)fn; }
+void class_addfloat(t_class *c, t_method fn) { (void)c, (void)fn; }
+void class_addsymbol(t_class *c, t_method fn) { (void)c, (void)fn; }
+void class_addlist(t_class *c, t_method fn) { (void)c, (void)fn; }
+void class_addanything(t_class *c, t_method fn) { (void)c, (void)fn; }
+void class_domainsignalin(t_class *c, int onset) { (void)c, (void)onset; }
+
+t_pd *pd_new(t_class *cls)
+{
+	t_pd *x = (t_pd *)calloc(1, cls->c_size);
+	*x = cls;
+	return x;
+}
+
+void pd_free(t_pd *x)
+{
+	free(x);
+}
+
+static t_inlet pdstub_inlet;
+
+t_inlet *inlet_new(t_object *owner, t_pd *dest, t_symbol *s1, t_symbol *s2)
+{
+	(void)owner, (void)dest, (void)s1, (void)s2;
+	return &pdstub_inlet;
+}
+
+t_inlet *symbolinlet_new(t_object *owner, t_symbol **sp)
+{
+	(void)owner, (void)sp;
+	return &pdstub_inlet;
+}
+
+t_inlet *floatinlet_new(t_object *owner, t_float *fp)
+{
+	(void)owner, (void)fp;
+	return &pdstub_inlet;
+}
+
+t_outlet *outlet_new(t_object *owner, t_symbol *s)
+{
+	t_outlet *x = (t_outlet *)calloc(1, sizeof(t_outlet)), **last;
+	(void)s;
+	x->o_owner = owner;
+	for (last = &owner->te_outlet; *last; last = &(*last)->o_next)
+		x->o_index++;
+	*last = x;
+	return x;
+}
+
+void outlet_anything(t_outlet *x, t_symbol *s, int argc, t_atom *argv)
+{
+	if (pdstub_outlethook)
+		pdstub_outlethook(x->o_owner, x->o_index, s, argc, argv);
+}
+
+void outlet_list(t_outlet *x, t_symbol *s, int argc, t_atom *argv)
+{
+	(void)s;
+	outlet_anything(x, &s_list, argc, argv);
+}
+
+void outlet_bang(t_outlet *x)
+{
+	outlet_anything(x, &s_bang, 0, 0);
+}
+
+void outlet_float(t_outlet *x, t_float f)
+{
+	t_atom a;
+	SETFLOAT(&a, f);
+	outlet_anything(x, &s_float, 1, &a);
+}
+
+void outlet_symbol(t_outlet *x, t_symbol *s)
+{
+	t_atom a;
+	SETSYMBOL(&a, s);
+	outlet_anything(x, &s_symbol, 1, &a);
+}
+
+/* ---------------------------- clocks ----------------------------------------- */
+
+struct _clock
+{
+	void *c_owner;
+	t_method c_fn;
+	double c_settime; /* logical time the clock is set for, or -1 if unset */
+	struct _clock *c_next;
+};
+
+static t_clock *pdstub_clocks;
+static double pdstub_time;
+
+t_clock *clock_new(void *owner, t_method fn)
+{
+	t_clock *x = (t_clock *)calloc(1, sizeof(t_clock));
+	x->c_owner = owner;
+	x->c_fn = fn;
+	x->c_settime = -1;
+	x->c_next = pdstub_clocks;
+	pdstub_clocks = x;
+	return x;
+}
+
+void clock_set(t_clock *x, double systime)
+{
+	x->c_settime = (systime < pdstub_time ? pdstub_time : systime);
+}
+
+void clock_delay(t_clock *x, double delaytime)
+{
+	clock_set(x, pdstub_time + (delaytime > 0 ? delaytime : 0));
+}
+
+void clock_unset(t_clock *x)
+{
+	x->c_settime = -1;
+}
+
+void clock_free(t_clock *x)
+{
+	t_clock **c;
+	for (c = &pdstub_clocks; *c; c = &(*c)->c_next)
+		if (*c == x)
+		{
+			*c = x->c_next;
+			break;
+		}
+	free(x);
+}
+
+double clock_getlogicaltime(void)
+{
+	return pdstub_time;
+}
+
+double clock_gettimesince(double prevsystime)
+{
+	return pdstub_time - prevsystime;
+}
+
+void pdstub_advance(double ms)
+{
+	double end = pdstub_time + (ms > 0 ? ms : 0);
+	t_clock *c, *next;
+
+	for (;;)
+	{
+		/* run the clock that is due first, they may set each other */
+		for (next = 0, c = pdstub_clocks; c; c = c->c_next)
+			if (c->c_settime >= 0 && c->c_settime <= end && (!next || c->c_settime < next->c_settime))
+				next = c;
+		if (!next)
+			break;
+		pdstub_time = next->c_settime;
+		next->c_settime = -1;
+		((void (*)(void *))next->c_fn)(next->c_owner);
+	}
+	pdstub_time = end;
+}
+
+/* ---------------------------- DSP -------------------------------------------- */
+
+#define MAXDSPARGS 8
+#define MAXDSPROUTINES 64
+
+typedef struct
+{
+	t_perfroutine d_fn;
+	t_int d_args[MAXDSPARGS + 1]; /* d_args[0] is unused, like in Pd */
+} t_pdstub_dsp;
+
+static t_pdstub_dsp pdstub_dspchain[MAXDSPROUTINES];
+static int pdstub_numdsp;
+
+void dsp_add(t_perfroutine f, int n, ...)
+{
+	t_pdstub_dsp *d = &pdstub_dspchain[pdstub_numdsp];
+	va_list ap;
+	int i;
+
+	if (pdstub_numdsp == MAXDSPROUTINES)
+	{
+		fprintf(stderr, "pdstub: too many DSP routines\n");
+		abort();
+	}
+	pdstub_numdsp++;
+	d->d_fn = f;
+	va_start(ap, n);
+	for (i = 0; i < n && i < MAXDSPARGS; i++)
+		d->d_args[i + 1] = va_arg(ap, t_int);
+	va_end(ap);
+}
+
+void pdstub_dsptick(void)
+{
+	int i;
+	for (i = 0; i < pdstub_numdsp; i++)
+		pdstub_dspchain[i].d_fn(pdstub_dspchain[i].d_args);
+}
+
+void pdstub_dspreset(void)
+{
+	pdstub_numdsp = 0;
+}
+
+t_float sys_getsr(void)
+{
+	return 44100;
+}
+
+/* ---------------------------- atoms ------------------------------------------ */
+
+t_float atom_getfloat(const t_atom *a)
+{
+	return (a->a_type == A_FLOAT ? a->a_w.w_float : 0);
+}
+
+t_symbol *atom_getsymbol(const t_atom *a)
+{
+	return (a->a_type == A_SYMBOL ? a->a_w.w_symbol : &s_);
+}
+
+t_float atom_getfloatarg(int which, int argc, const t_atom *argv)
+{
+	return (which < argc ? atom_getfloat(argv + which) : 0);
+}
+
+t_symbol *atom_getsymbolarg(int which, int argc, const t_atom *argv)
+{
+	return (which < argc ? atom_getsymbol(argv + which) : &s_);
+}
+
+/* ---------------------------- canvases --------------------------------------- */
+
+t_canvas *canvas_getcurrent(void)
+{
+	return 0;
+}
+
+/* Relative paths are relative to the working directory of the test program. */
+t_symbol *canvas_getdir(const t_canvas *x)
+{
+	(void)x;
+	return gensym(".");
+}
+
+int sys_isabsolutepath(const char *dir)
+{
+	return (dir[0] == '/' || (dir[0] && dir[1] == ':'));
+}
@@ -0,0 +1,107 @@
+/* ------------------------- pitchshifttest ----------------------------------- */
+/*                                                                              */
+/* Shifts a sine with pitchshift~ and checks the frequency that comes out.      */
+/* Built and run by "make check".                                               */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#include "pitchshift~.c"
+#include <stdio.h>
+
+#define BLOCKSIZE 64
+#define FREQ 440.
+#define SETTLE 0.5	  /* seconds for the glide to end, many times kGlideTime */
+#define MEASURE 1	  /* seconds of output that the frequency is measured in */
+#define TOLERANCE 1.5 /* Hz, a little more than the resolution of MEASURE */
+
+typedef struct
+{
+	const char *t_name;
+	void (*t_method)(t_pitchshift *x, t_floatarg f);
+	t_float t_arg;
+	double t_freq; /* that should come out */
+} t_pitchshifttest;
+
+static const t_pitchshifttest pitchshifttests[] = {
+	{"tune 2", pitchshift_tune, 2, 493.88},
+	{"tune -2", pitchshift_tune, -2, 392.00},
+	{"knob 1 before the middle", pitchshift_knob, 1, FREQ}, /* ignored until it is caught */
+};
+
+/* The power of <out> at <freq>, with the Goertzel algorithm. */
+static double pitchshifttest_power(const t_sample *out, int n, double freq)
+{
+	double coeff = 2 * cos(2 * M_PI * freq / 44100), s1 = 0, s2 = 0, s;
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		s = out[i] + coeff * s1 - s2;
+		s2 = s1;
+		s1 = s;
+	}
+	return s1 * s1 + s2 * s2 - coeff * s1 * s2;
+}
+
+/* Plays the sine into a new pitchshift~ and returns the number of problems. */
+static int pitchshifttest_run(const t_pitchshifttest *t, t_sample *out)
+{
+	t_signal insignal = {0}, outsignal = {0}, *sp[2] = {&insignal, &outsignal};
+	t_sample in[BLOCKSIZE];
+	double phase = 0, f, power, best = 0, bestfreq = 0;
+	int b, i, settle = SETTLE * 44100 / BLOCKSIZE, n = MEASURE * 44100 / BLOCKSIZE * BLOCKSIZE;
+	t_pitchshift *x = (t_pitchshift *)pitchshift_new();
+
+	insignal.s_n = outsignal.s_n = BLOCKSIZE;
+	insignal.s_vec = in;
+	insignal.s_sr = outsignal.s_sr = 44100;
+	pdstub_dspreset();
+	t->t_method(x, t->t_arg);
+
+	for (b = 0; b < settle + n / BLOCKSIZE; b++)
+	{
+		for (i = 0; i < BLOCKSIZE; i++)
+		{
+			in[i] = 0.5f * (t_sample)sin(phase);
+			phase += 2 * M_PI * FREQ / 44100;
+		}
+		/* the output goes straight to where it is measured */
+		outsignal.s_vec = out + (b < settle ? 0 : (b - settle) * BLOCKSIZE);
+		pdstub_dspreset();
+		pitchshift_dsp(x, sp);
+		pdstub_dsptick();
+	}
+
+	for (f = 300; f < 600; f += 0.25)
+		if ((power = pitchshifttest_power(out, n, f)) > best)
+			best = power, bestfreq = f;
+	printf("pitchshifttest: %s: %g Hz -> %g Hz\n", t->t_name, FREQ, bestfreq);
+
+	pitchshift_free(x);
+	pd_free((t_pd *)x);
+	if (fabs(bestfreq - t->t_freq) > TOLERANCE)
+	{
+		fprintf(stderr, "pitchshifttest: %s: the output is not at %g Hz\n", t->t_name, t->t_freq);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	t_sample *out = (t_sample *)getbytes(MEASURE * 44100 * sizeof(t_sample));
+	int t, problems = 0;
+
+	pitchshift_tilde_setup();
+	for (t = 0; t < (int)(sizeof(pitchshifttests) / sizeof(pitchshifttests[0])); t++)
+		problems += pitchshifttest_run(&pitchshifttests[t], out);
+	freebytes(out, MEASURE * 44100 * sizeof(t_sample));
+
+	if (problems)
+	{
+		fprintf(stderr, "pitchshifttest: FAILED\n");
+		return 1;
+	}
+	printf("pitchshifttest: every sine came out at its frequency\n");
+	return 0;
+}
@@ -0,0 +1,214 @@
+/* ------------------------- samplerbench ------------------------------------- */
+/*                                                                              */
+/* Measures the memory and the DSP time per voice of sampler~ for the WAV files */
+/* and for banks in every format, outside of Pd, and checks that the banks play */
+/* the same frames as the WAV files. Built and run by "make bench-sampler".     */
+/*                                                                              */
+/* Usage: samplerbench [-v voices] [-b blocks] <directory> [bank ...]           */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#include "sampler~.c"
+
+#include <stdlib.h>
+#include <time.h>
+
+#define BLOCKSIZE 64 /* samples per DSP block, like in Pd */
+
+static unsigned int bench_seed = 1;
+
+/* Deterministic, so that runs are comparable. */
+static int bench_random(int range)
+{
+	bench_seed ^= bench_seed << 13;
+	bench_seed ^= bench_seed >> 17;
+	bench_seed ^= bench_seed << 5;
+	return (int)(bench_seed % (unsigned int)range);
+}
+
+static double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Loads the WAV files of a directory, or a bank file if <isbank>. Returns NULL if it can't. */
+static t_sampler_bank *bench_load(const char *path, int isbank)
+{
+	t_sampler_load *l = sampler_load_new(gensym(path), 0);
+
+	l->l_ok = isbank ? sampler_bank_mapfile(l, path) : sampler_bank_readwavs(l, path);
+	return sampler_load_finish(0, l);
+}
+
+static t_sample bench_silence[BLOCKSIZE]; /* into the left inlet, so that only "play" starts voices */
+
+static t_sampler *bench_sampler(t_sampler_bank *b, int voices, t_sample *out)
+{
+	t_sampler *x = (t_sampler *)pd_new(sampler_class);
+	t_signal signals[2], *sp[2] = {&signals[0], &signals[1]};
+	int i;
+
+	x->x_bank = b;
+	b->b_refcount++;
+	x->x_numvoices = voices;
+	for (i = 0; i < 2; i++)
+	{
+		signals[i].s_n = BLOCKSIZE;
+		signals[i].s_vec = i ? out : bench_silence;
+		signals[i].s_sr = 44100;
+	}
+	pdstub_dspreset();
+	sampler_dsp(x, sp);
+	return x;
+}
+
+/* Frees the voices of <x> in the pool, which pd_free of the stub doesn't do. */
+static void bench_free(t_sampler *x)
+{
+	sampler_free(x);
+	pd_free((t_pd *)x);
+}
+
+/* The number of voices of <x> that are playing and not fading out. */
+static int bench_busy(t_sampler *x)
+{
+	int busy = 0, v;
+
+	for (v = 0; v < MAX_VOICES; v++)
+		busy += (sampler_pool.p_owner[v] == x && !sampler_pool.p_fade[v]);
+	return busy;
+}
+
+/* The largest difference between the frames played from a bank and from the WAV files. */
+static double bench_compare(t_sampler_bank *b, t_sampler_bank *wavs)
+{
+	t_sample out[BLOCKSIZE], expected[BLOCKSIZE];
+	t_sampler *x = bench_sampler(b, 1, out), *y = bench_sampler(wavs, 1, expected);
+	t_int xargs[5] = {0, (t_int)x, (t_int)bench_silence, (t_int)out, BLOCKSIZE};
+	t_int yargs[5] = {0, (t_int)y, (t_int)bench_silence, (t_int)expected, BLOCKSIZE};
+	double error = 0, d;
+	int i, j;
+
+	for (i = 0; i < wavs->b_tablesize; i++)
+	{
+		if (!wavs->b_table[i].name)
+			continue;
+		if (!sampler_find(b, wavs->b_table[i].name))
+			return 1e9;
+		sampler_play(x, wavs->b_table[i].name);
+		sampler_play(y, wavs->b_table[i].name);
+		while (bench_busy(y))
+		{
+			sampler_perform(xargs);
+			sampler_perform(yargs);
+			for (j = 0; j < BLOCKSIZE; j++)
+				if ((d = out[j] > expected[j] ? out[j] - expected[j] : expected[j] - out[j]) > error)
+					error = d;
+		}
+	}
+	bench_free(x);
+	bench_free(y);
+	return error;
+}
+
+/* Keeps <voices> voices busy with random samples and returns the mean time per block. */
+static double bench_play(t_sampler_bank *b, int voices, int blocks)
+{
+	t_sample out[BLOCKSIZE];
+	t_sampler *x = bench_sampler(b, voices, out);
+	t_symbol **names = (t_symbol **)malloc(b->b_numsamples * sizeof(t_symbol *));
+	int numnames = 0, i, busy;
+	double start, total = 0;
+
+	for (i = 0; i < b->b_tablesize; i++)
+		if (b->b_table[i].name && b->b_table[i].length > 0)
+			names[numnames++] = b->b_table[i].name;
+	for (i = 0; i < blocks; i++)
+	{
+		busy = bench_busy(x);
+		while (busy++ < voices)
+			sampler_play(x, names[bench_random(numnames)]);
+		start = bench_now();
+		pdstub_dsptick();
+		total += bench_now() - start;
+	}
+	free(names);
+	bench_free(x);
+	return total / blocks;
+}
+
+static size_t bench_memory(t_sampler_bank *b)
+{
+	size_t bytes = 0;
+	int i;
+
+	if (b->b_map)
+		return b->b_mapsize;
+	for (i = 0; i < b->b_tablesize; i++)
+		if (b->b_table[i].name)
+			bytes += b->b_table[i].length * sizeof(float);
+	return bytes;
+}
+
+static void bench_report(const char *name, t_sampler_bank *b, t_sampler_bank *wavs, int voices, int blocks)
+{
+	static const char *formats[] = {"float32", "int16", "block"};
+	double time = bench_play(b, voices, blocks), error = bench_compare(b, wavs);
+
+	printf("%-24s %-8s %8.1f %10.1f %10.3f %12.2g\n", name, formats[b->b_format], bench_memory(b) / 1048576.0, time / voices,
+		   100 * time / (1e9 * BLOCKSIZE / 44100), error);
+}
+
+int main(int argc, char **argv)
+{
+	t_sampler_bank *wavs, *b;
+	int voices = 8, blocks = 20000, i;
+	double start;
+
+	while (argc > 2 && argv[1][0] == '-')
+	{
+		if (!strcmp(argv[1], "-v"))
+			voices = atoi(argv[2]);
+		else if (!strcmp(argv[1], "-b"))
+			blocks = atoi(argv[2]);
+		else
+			argc = 0;
+		argc -= 2, argv += 2;
+	}
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: samplerbench [-v voices] [-b blocks] <directory> [bank ...]\n");
+		return 2;
+	}
+	voices = voices < 1 ? 1 : voices > MAX_VOICES ? MAX_VOICES : voices;
+	sampler_pool.p_limit = voices < 2 ? 2 : voices; /* bench_compare plays two voices at once */
+	if (blocks < 1)
+		blocks = 1;
+
+	sampler_tilde_setup();
+	start = bench_now();
+	if (!(wavs = bench_load(argv[1], 0)))
+		return 1;
+	printf("decoding %d WAV files: %.1f ms\n", wavs->b_numsamples, (bench_now() - start) / 1e6);
+	printf("%d voices, %d blocks of %d samples\n\n", voices, blocks, BLOCKSIZE);
+	printf("%-24s %-8s %8s %10s %10s %12s\n", "samples", "format", "MB", "ns/voice", "% of block", "max error");
+
+	bench_report(argv[1], wavs, wavs, voices, blocks);
+	for (i = 2; i < argc; i++)
+	{
+		if ((b = bench_load(argv[i], 1)))
+		{
+			bench_report(argv[i], b, wavs, voices, blocks);
+			sampler_bank_free(b);
+		}
+		else
+			fprintf(stderr, "samplerbench: %s: can't map\n", argv[i]);
+	}
+	printf("\nns/voice is the DSP time for one voice and one block, %% of block the share of the\n"
+		   "time that a block of %d samples lasts at 44.1 kHz that all voices take together\n", BLOCKSIZE);
+
+	sampler_bank_free(wavs);
+	return 0;
+}
@@ -0,0 +1,172 @@
+/* ------------------------- samplertest -------------------------------------- */
+/*                                                                              */
+/* Plays a quiet recording with a lead-in and a pause at its noise floor with   */
+/* sampler~, and checks that the voice plays through both and ends once the     */
+/* recording has died away. Built and run by "make check".                      */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#include "sampler~.c"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BLOCKSIZE 64
+#define LOUD 0.01f	 /* -40 dB, the peak of the notes */
+#define FLOOR 5e-5f	 /* -86 dB, the noise floor, below kSilence but only 46 dB below LOUD */
+#define FREQ 440.
+
+typedef struct
+{
+	const char *t_name;
+	float t_level; /* 0 for silence */
+	int t_ms;
+} t_samplertest_part;
+
+static const t_samplertest_part samplertest_parts[] = {
+	{"lead-in", FLOOR, 300},
+	{"note", LOUD, 200},
+	{"pause", FLOOR, 300},
+	{"note", LOUD, 200},
+	{"silence", 0, 500},
+};
+
+#define NUMPARTS (int)(sizeof(samplertest_parts) / sizeof(samplertest_parts[0]))
+
+/* The part that <frame> is in, and the frame that the part starts at in <start>. */
+static int samplertest_part(int frame, int *start)
+{
+	int p;
+
+	for (p = 0, *start = 0; p < NUMPARTS - 1 && frame >= *start + samplertest_parts[p].t_ms * 441 / 10; p++)
+		*start += samplertest_parts[p].t_ms * 441 / 10;
+	return p;
+}
+
+static void samplertest_le(FILE *fd, unsigned int value, int bytes)
+{
+	while (bytes--)
+		fputc(value & 0xff, fd), value >>= 8;
+}
+
+/* Writes the parts as a mono WAV file of 32-bit floats, and returns its frames, or 0. */
+static int samplertest_write(const char *path)
+{
+	FILE *fd = fopen(path, "wb");
+	int frames = 0, p, i;
+	float y;
+
+	if (!fd)
+		return 0;
+	for (p = 0; p < NUMPARTS; p++)
+		frames += samplertest_parts[p].t_ms * 441 / 10;
+	fwrite("RIFF", 1, 4, fd);
+	samplertest_le(fd, 36 + frames * 4, 4);
+	fwrite("WAVEfmt ", 1, 8, fd);
+	samplertest_le(fd, 16, 4);
+	samplertest_le(fd, 3, 2); /* floats */
+	samplertest_le(fd, 1, 2);
+	samplertest_le(fd, 44100, 4);
+	samplertest_le(fd, 44100 * 4, 4);
+	samplertest_le(fd, 4, 2);
+	samplertest_le(fd, 32, 2);
+	fwrite("data", 1, 4, fd);
+	samplertest_le(fd, frames * 4, 4);
+	for (p = 0, frames = 0; p < NUMPARTS; p++)
+		for (i = 0; i < samplertest_parts[p].t_ms * 441 / 10; i++, frames++)
+		{
+			y = samplertest_parts[p].t_level * (float)sin(2 * M_PI * FREQ * frames / 44100);
+			fwrite(&y, sizeof(y), 1, fd);
+		}
+	fclose(fd);
+	return frames;
+}
+
+int main(void)
+{
+	char dir[] = "/tmp/samplertest.XXXXXX", path[MAXPDSTRING];
+	t_sample in[BLOCKSIZE] = {0}, out[BLOCKSIZE]; /* only "play" starts the voice */
+	t_signal signals[2], *sp[2] = {&signals[0], &signals[1]};
+	t_int args[5] = {0, 0, (t_int)in, (t_int)out, BLOCKSIZE};
+	t_sampler_load *l;
+	t_sampler_bank *b = 0;
+	t_sampler *x;
+	int frames, start, silence, end = -1, played, p, i, v, problems = 0;
+	float peaks[NUMPARTS] = {0};
+
+	sampler_tilde_setup();
+	if (!mkdtemp(dir))
+	{
+		fprintf(stderr, "samplertest: can't make a directory in /tmp\n");
+		return 1;
+	}
+	snprintf(path, sizeof(path), "%s/gap.wav", dir);
+	if ((frames = samplertest_write(path)))
+	{
+		l = sampler_load_new(gensym(dir), 0);
+		l->l_ok = sampler_bank_readwavs(l, dir);
+		b = sampler_load_finish(0, l);
+	}
+	remove(path);
+	rmdir(dir);
+	if (!b)
+	{
+		fprintf(stderr, "samplertest: can't load %s\n", path);
+		return 1;
+	}
+
+	x = (t_sampler *)pd_new(sampler_class);
+	x->x_bank = b;
+	b->b_refcount++;
+	x->x_numvoices = 1;
+	for (i = 0; i < 2; i++)
+	{
+		signals[i].s_n = BLOCKSIZE;
+		signals[i].s_vec = i ? out : in;
+		signals[i].s_sr = 44100;
+	}
+	pdstub_dspreset();
+	sampler_dsp(x, sp);
+	args[1] = (t_int)x;
+
+	// FWN: Note the peak of every part, and the frame after the block in which the voice ended.
+	sampler_play(x, gensym("gap"));
+	for (played = 0; played < frames + BLOCKSIZE && end < 0; played += BLOCKSIZE)
+	{
+		sampler_perform(args);
+		for (i = 0; i < BLOCKSIZE; i++)
+		{
+			p = samplertest_part(played + i, &start);
+			peaks[p] = fmaxf(peaks[p], fabsf(out[i]));
+		}
+		for (v = 0; v < MAX_VOICES && sampler_pool.p_owner[v] != x; v++)
+			;
+		if (v == MAX_VOICES)
+			end = played + BLOCKSIZE;
+	}
+
+	printf("samplertest: gap.wav:");
+	for (p = 0; p < NUMPARTS; p++)
+		printf(" %s %.2g", samplertest_parts[p].t_name, peaks[p]);
+	printf(", ended at %d of %d frames\n", end, frames);
+
+	for (p = 0; p < NUMPARTS; p++)
+		if (samplertest_parts[p].t_level && peaks[p] < samplertest_parts[p].t_level / 2)
+			problems++, fprintf(stderr, "samplertest: the %s was not played\n", samplertest_parts[p].t_name);
+	// FWN: The quiet time is counted from the first block that is all silence, so the voice
+	// should end in the block after the one in which the silence has lasted kQuietTime.
+	samplertest_part(frames - 1, &silence);
+	if (end < silence + sampler_pool.p_quietlength || end > silence + sampler_pool.p_quietlength + 2 * BLOCKSIZE)
+		problems++, fprintf(stderr, "samplertest: the voice did not end %g ms into the silence\n", kQuietTime);
+
+	sampler_free(x);
+	pd_free((t_pd *)x);
+	sampler_bank_free(b);
+	if (problems)
+	{
+		fprintf(stderr, "samplertest: FAILED\n");
+		return 1;
+	}
+	printf("samplertest: the voice played through the lead-in and the pause, and ended in the silence\n");
+	return 0;
+}
@@ -0,0 +1,101 @@
+/* ------------------------- strumtest ---------------------------------------- */
+/*                                                                              */
+/* Strums across several blocks with strum~, starting in the middle of a block, */
+/* and checks the sample of every onset and the order of the strings.           */
+/* Built and run by "make check".                                               */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#include "strum~.c"
+#include <stdio.h>
+
+#define BLOCKSIZE 64
+#define BLOCKS 10 /* enough for the strums below */
+#define STRINGS 4
+
+typedef struct
+{
+	const char *t_name;
+	void (*t_strum)(t_strum *x);
+	double t_delay;			  /* ms from the start of the block to the message */
+	t_float t_tempo;		  /* ms */
+	int t_onsets[STRINGS];	  /* sample of every string, counted from the first block */
+} t_strumtest;
+
+// FWN: The strums start at sample 64 + 44.1 * delay, and the strings follow each other
+// by 44.1 * tempo samples. Every onset falls on the sample that its time falls in.
+static const t_strumtest strumtests[] = {
+	{"down", strum_down, 1, 1, {240, 196, 152, 108}},
+	{"up", strum_up, 0.5, 2, {86, 174, 262, 350}},
+};
+
+/* Runs a block, then the strum <delay> ms later, and returns the number of problems. */
+static int strumtest_run(const t_strumtest *t)
+{
+	t_sample outs[STRINGS][BLOCKSIZE];
+	t_signal signals[STRINGS], *sp[STRINGS];
+	double blockms = 1000. * BLOCKSIZE / 44100;
+	int onsets[STRINGS], count[STRINGS] = {0};
+	int b, i, s, problems = 0;
+	t_strum *x = (t_strum *)strum_new(STRINGS);
+
+	for (s = 0; s < STRINGS; s++)
+	{
+		signals[s].s_n = BLOCKSIZE;
+		signals[s].s_vec = outs[s];
+		signals[s].s_sr = 44100;
+		sp[s] = &signals[s];
+	}
+	pdstub_dspreset();
+	strum_dsp(x, sp);
+	strum_tempo(x, t->t_tempo);
+
+	for (b = 0; b < BLOCKS; b++)
+	{
+		pdstub_dsptick();
+		for (s = 0; s < STRINGS; s++)
+			for (i = 0; i < BLOCKSIZE; i++)
+				if (outs[s][i] != 0)
+					onsets[s] = b * BLOCKSIZE + i, count[s]++;
+		if (b == 0)
+		{
+			pdstub_advance(t->t_delay);
+			t->t_strum(x);
+			pdstub_advance(blockms - t->t_delay);
+		}
+		else
+			pdstub_advance(blockms);
+	}
+
+	printf("strumtest: %s at %g ms:", t->t_name, t->t_delay);
+	for (s = 0; s < STRINGS; s++)
+		printf(count[s] ? " %d" : " -", onsets[s]);
+	printf("\n");
+
+	for (s = 0; s < STRINGS; s++)
+		if (count[s] != 1 || onsets[s] != t->t_onsets[s])
+			problems++, fprintf(stderr, "strumtest: %s: string %d is not plucked once at sample %d\n", t->t_name, s + 1, t->t_onsets[s]);
+	if (!problems)
+		for (s = 1; s < STRINGS; s++)
+			if ((t->t_strum == strum_down) != (onsets[s] < onsets[s - 1]))
+				problems++, fprintf(stderr, "strumtest: %s: strings %d and %d are out of order\n", t->t_name, s, s + 1);
+	pd_free((t_pd *)x);
+	return problems;
+}
+
+int main(void)
+{
+	int t, problems = 0;
+
+	strum_tilde_setup();
+	for (t = 0; t < (int)(sizeof(strumtests) / sizeof(strumtests[0])); t++)
+		problems += strumtest_run(&strumtests[t]);
+
+	if (problems)
+	{
+		fprintf(stderr, "strumtest: FAILED\n");
+		return 1;
+	}
+	printf("strumtest: every string was plucked at its sample, in order\n");
+	return 0;
+}